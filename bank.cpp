@@ -0,0 +1,424 @@
+#include "bank.h"
+
+#include <Arduino.h>
+
+#define CACHE_FILE "LFOBANK.BIN"
+#define CACHE_TEMP_FILE "LFOBANK.TMP"
+#define PRESETS_FILE "PRESETS.TXT"
+#define CACHE_VERSION 2
+
+// Longest path built from a directory and a file name
+#define PATH_MAX_LEN 64
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t signature;
+    uint16_t tables;
+    uint16_t presets;
+    // Sizes of the raw structs that follow, which change between builds
+    uint16_t table_size;
+    uint16_t preset_size;
+};
+
+static bool has_extension(const char* name, const char* ext) {
+    int len = strlen(name);
+    int ext_len = strlen(ext);
+    return len > ext_len && strcasecmp(name + len - ext_len, ext) == 0;
+}
+
+static void join(char* path, const char* dir, const char* name) {
+    snprintf(path, PATH_MAX_LEN, "%s/%s", dir, name);
+}
+
+// FNV-1a
+static uint32_t sign(uint32_t hash, const void* data, int n) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (int i = 0; i < n; i++) {
+        hash = (hash ^ bytes[i]) * 16777619;
+    }
+    return hash;
+}
+
+// Packed into one word, so struct padding never reaches the hash
+static uint32_t modify_time(File& entry) {
+    DateTimeFields tm;
+    if (!entry.getModifyTime(tm)) {
+        return 0;
+    }
+    return (uint32_t)tm.year << 25 | (uint32_t)tm.mon << 21 |
+           (uint32_t)tm.mday << 16 | (uint32_t)tm.hour << 11 |
+           (uint32_t)tm.min << 5 | tm.sec >> 1;
+}
+
+static uint16_t read_u16(const uint8_t* in) { return in[0] | (in[1] << 8); }
+
+static uint32_t read_u32(const uint8_t* in) {
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+bool LFOBank::begin(const char* dir) {
+    _tables = 0;
+    _presets = 0;
+    parse_us = 0;
+    load_us = 0;
+    from_cache = false;
+
+    uint32_t signature;
+    if (!scan(dir, &signature)) {
+        return false;
+    }
+
+    uint32_t started = micros();
+    if (load_cache(dir, signature)) {
+        load_us = micros() - started;
+        from_cache = true;
+        return true;
+    }
+
+    started = micros();
+    parse(dir);
+    parse_us = micros() - started;
+    save_cache(dir, signature);
+    return true;
+}
+
+bool LFOBank::scan(const char* dir, uint32_t* signature) {
+    File root = SD.open(dir);
+    if (!root || !root.isDirectory()) {
+        return false;
+    }
+
+    uint32_t sizes[LFO_BANK_TABLES];
+    uint32_t times[LFO_BANK_TABLES];
+    uint32_t presets_size = 0;
+    uint32_t presets_time = 0;
+    while (true) {
+        File entry = root.openNextFile();
+        if (!entry) {
+            break;
+        }
+        const char* name = entry.name();
+        uint32_t size = entry.size();
+        uint32_t time = modify_time(entry);
+        bool table =
+            !entry.isDirectory() &&
+            (has_extension(name, ".csv") || has_extension(name, ".wav"));
+        if (!entry.isDirectory() && strcasecmp(name, PRESETS_FILE) == 0) {
+            presets_size = size;
+            presets_time = time;
+        }
+        if (table && strlen(name) < LFO_BANK_NAME) {
+            // Keep the first tables by name, in order
+            int at = _tables;
+            while (at > 0 && strcasecmp(name, _table_names[at - 1]) < 0) {
+                at--;
+            }
+            if (at < LFO_BANK_TABLES) {
+                int last = min(_tables, LFO_BANK_TABLES - 1);
+                for (int i = last; i > at; i--) {
+                    strcpy(_table_names[i], _table_names[i - 1]);
+                    sizes[i] = sizes[i - 1];
+                    times[i] = times[i - 1];
+                }
+                strcpy(_table_names[at], name);
+                sizes[at] = size;
+                times[at] = time;
+                if (_tables < LFO_BANK_TABLES) {
+                    _tables++;
+                }
+            }
+        }
+        entry.close();
+    }
+    root.close();
+
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < _tables; i++) {
+        hash = sign(hash, _table_names[i], strlen(_table_names[i]) + 1);
+        hash = sign(hash, &sizes[i], sizeof(sizes[i]));
+        hash = sign(hash, &times[i], sizeof(times[i]));
+    }
+    hash = sign(hash, &presets_size, sizeof(presets_size));
+    hash = sign(hash, &presets_time, sizeof(presets_time));
+    *signature = hash;
+    return true;
+}
+
+bool LFOBank::load_cache(const char* dir, uint32_t signature) {
+    char path[PATH_MAX_LEN];
+    join(path, dir, CACHE_FILE);
+    File file = SD.open(path);
+    if (!file) {
+        return false;
+    }
+    CacheHeader header;
+    bool ok = file.read(&header, sizeof(header)) == sizeof(header) &&
+              memcmp(header.magic, "LFOB", 4) == 0 &&
+              header.version == CACHE_VERSION &&
+              header.signature == signature &&
+              header.table_size == sizeof(LFOTable) &&
+              header.preset_size == sizeof(LFOPreset) &&
+              header.tables <= _tables && header.presets <= LFO_BANK_PRESETS;
+    if (ok) {
+        // The data sections go straight into place, with nothing to parse.
+        // Tables that failed to parse aren't in the cache. The names are
+        // read aside, so a short file leaves scan()'s list to parse from.
+        char names[LFO_BANK_TABLES][LFO_BANK_NAME];
+        int names_size = header.tables * LFO_BANK_NAME;
+        int tables_size = header.tables * sizeof(LFOTable);
+        int presets_size = header.presets * sizeof(LFOPreset);
+        ok = file.read(names, names_size) == names_size &&
+             file.read(_table_data, tables_size) == tables_size &&
+             file.read(_preset_data, presets_size) == presets_size;
+        if (ok) {
+            memcpy(_table_names, names, names_size);
+            _tables = header.tables;
+            _presets = header.presets;
+        }
+    }
+    file.close();
+    return ok;
+}
+
+void LFOBank::save_cache(const char* dir, uint32_t signature) {
+    // Written aside and renamed into place, so a power cut mid-write never
+    // leaves a cache that's cut short
+    char path[PATH_MAX_LEN];
+    char temp[PATH_MAX_LEN];
+    join(path, dir, CACHE_FILE);
+    join(temp, dir, CACHE_TEMP_FILE);
+    if (SD.exists(temp)) {
+        SD.remove(temp);
+    }
+    File file = SD.open(temp, FILE_WRITE);
+    if (!file) {
+        return;
+    }
+    CacheHeader header;
+    memcpy(header.magic, "LFOB", 4);
+    header.version = CACHE_VERSION;
+    header.signature = signature;
+    header.tables = _tables;
+    header.presets = _presets;
+    header.table_size = sizeof(LFOTable);
+    header.preset_size = sizeof(LFOPreset);
+    size_t names_size = _tables * LFO_BANK_NAME;
+    size_t tables_size = _tables * sizeof(LFOTable);
+    size_t presets_size = _presets * sizeof(LFOPreset);
+    bool ok =
+        file.write((const uint8_t*)&header, sizeof(header)) ==
+            sizeof(header) &&
+        file.write((const uint8_t*)_table_names, names_size) == names_size &&
+        file.write((const uint8_t*)_table_data, tables_size) == tables_size &&
+        file.write((const uint8_t*)_preset_data, presets_size) ==
+            presets_size;
+    file.close();
+    if (!ok) {
+        SD.remove(temp);
+        return;
+    }
+    if (SD.exists(path)) {
+        SD.remove(path);
+    }
+    SD.rename(temp, path);
+}
+
+void LFOBank::parse(const char* dir) {
+    char path[PATH_MAX_LEN];
+    uint8_t points[LFO_BANK_POINTS];
+
+    // Tables that fail to parse are left out, and the cache is still
+    // signed with them, so they aren't parsed again until they change
+    int kept = 0;
+    for (int i = 0; i < _tables; i++) {
+        join(path, dir, _table_names[i]);
+        File file = SD.open(path);
+        if (!file) {
+            continue;
+        }
+        uint32_t n = 0;
+        bool ok = has_extension(_table_names[i], ".wav")
+                      ? parse_wav(file, points, &n)
+                      : parse_csv(file, points, &n);
+        file.close();
+        if (!ok || n == 0) {
+            continue;
+        }
+        if (kept != i) {
+            strcpy(_table_names[kept], _table_names[i]);
+        }
+        _table_data[kept] = lfo_table(points, n);
+        kept++;
+    }
+    _tables = kept;
+
+    join(path, dir, PRESETS_FILE);
+    File file = SD.open(path);
+    if (file) {
+        parse_presets(file);
+        file.close();
+    }
+}
+
+bool LFOBank::parse_csv(File& file, uint8_t* points, uint32_t* n) {
+    uint8_t buffer[64];
+    int32_t value = -1;
+    bool comment = false;
+    *n = 0;
+    while (*n < LFO_BANK_POINTS) {
+        int count = file.read(buffer, sizeof(buffer));
+        if (count <= 0) {
+            break;
+        }
+        for (int i = 0; i < count && *n < LFO_BANK_POINTS; i++) {
+            char c = buffer[i];
+            if (comment) {
+                comment = c != '\n';
+            } else if (c >= '0' && c <= '9') {
+                value = (value < 0 ? 0 : value * 10) + (c - '0');
+                if (value > 255) {
+                    value = 255;
+                }
+                continue;
+            } else if (c == '#') {
+                comment = true;
+            }
+            if (value >= 0) {
+                points[(*n)++] = value;
+                value = -1;
+            }
+        }
+    }
+    if (value >= 0 && *n < LFO_BANK_POINTS) {
+        points[(*n)++] = value;
+    }
+    return *n > 0;
+}
+
+bool LFOBank::parse_wav(File& file, uint8_t* points, uint32_t* n) {
+    uint8_t header[12];
+    if (file.read(header, 12) != 12 || memcmp(header, "RIFF", 4) != 0 ||
+        memcmp(header + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    uint16_t block_align = 0;
+    uint16_t bits = 0;
+    while (true) {
+        uint8_t chunk[8];
+        if (file.read(chunk, 8) != 8) {
+            return false;
+        }
+        uint32_t size = read_u32(chunk + 4);
+        uint32_t start = file.position();
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t fmt[16];
+            if (size < 16 || file.read(fmt, 16) != 16 ||
+                read_u16(fmt) != 1) {
+                // Only plain PCM
+                return false;
+            }
+            block_align = read_u16(fmt + 12);
+            bits = read_u16(fmt + 14);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (block_align == 0 || (bits != 8 && bits != 16)) {
+                return false;
+            }
+            uint32_t frames = size / block_align;
+            if (frames == 0) {
+                return false;
+            }
+            // Decimated to evenly spaced frames, the first and last kept
+            *n = min(frames, (uint32_t)LFO_BANK_POINTS);
+            for (uint32_t i = 0; i < *n; i++) {
+                uint32_t frame =
+                    *n > 1 ? (uint64_t)i * (frames - 1) / (*n - 1) : 0;
+                uint8_t sample[2];
+                if (!file.seek(start + frame * block_align) ||
+                    file.read(sample, bits / 8) != bits / 8) {
+                    return false;
+                }
+                // 8-bit WAV is unsigned, 16-bit is signed
+                points[i] = bits == 8 ? sample[0]
+                                      : (uint8_t)(sample[1] ^ 0x80);
+            }
+            return true;
+        }
+        // Chunks are padded to an even length
+        if (!file.seek(start + size + (size & 1))) {
+            return false;
+        }
+    }
+}
+
+void LFOBank::parse_presets(File& file) {
+    char line[96];
+    while (_presets < LFO_BANK_PRESETS && file.available()) {
+        int len = 0;
+        while (file.available()) {
+            int c = file.read();
+            if (c == '\n') {
+                break;
+            }
+            if (c != '\r' && len < (int)sizeof(line) - 1) {
+                line[len++] = c;
+            }
+        }
+        line[len] = 0;
+        if (len == 0 || line[0] == '#') {
+            continue;
+        }
+
+        LFOPreset& preset = _preset_data[_presets];
+        memset(&preset, 0, sizeof(preset));
+        preset.fade_ms = 3.0;
+        preset.mode = LFO_FREE;
+        preset.window = GRAIN_WINDOW_HANN;
+        preset.interpolation = GRAIN_INTERP_HERMITE;
+
+        char* field = strtok(line, ",");
+        for (int i = 0; field != NULL; i++, field = strtok(NULL, ",")) {
+            while (*field == ' ' || *field == '\t') {
+                field++;
+            }
+            int end = strlen(field);
+            while (end > 0 &&
+                   (field[end - 1] == ' ' || field[end - 1] == '\t')) {
+                field[--end] = 0;
+            }
+            switch (i) {
+                case 0:
+                    strncpy(preset.name, field, LFO_BANK_NAME - 1);
+                    break;
+                case 1:
+                    preset.fade_ms = atof(field);
+                    break;
+                case 2:
+                    if (strcasecmp(field, "oneshot") == 0) {
+                        preset.mode = LFO_ONE_SHOT;
+                    } else if (strcasecmp(field, "retrigger") == 0) {
+                        preset.mode = LFO_RETRIGGER;
+                    }
+                    break;
+                case 3:
+                    if (strcasecmp(field, "linear") == 0) {
+                        preset.window = GRAIN_WINDOW_LINEAR;
+                    } else if (strcasecmp(field, "power") == 0) {
+                        preset.window = GRAIN_WINDOW_EQUAL_POWER;
+                    }
+                    break;
+                case 4:
+                    if (strcasecmp(field, "none") == 0) {
+                        preset.interpolation = GRAIN_INTERP_NONE;
+                    } else if (strcasecmp(field, "linear") == 0) {
+                        preset.interpolation = GRAIN_INTERP_LINEAR;
+                    }
+                    break;
+            }
+        }
+        if (preset.name[0] != 0) {
+            _presets++;
+        }
+    }
+}
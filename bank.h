@@ -0,0 +1,126 @@
+// bank.h
+
+#include <Arduino.h>
+#include <SD.h>
+
+#include "interp.h"
+#include "lfo.h"
+#include "window.h"
+
+#pragma once
+
+#ifndef M_BANK_H_
+#define M_BANK_H_
+
+/**
+ * Most tables and presets a bank holds. Every table costs one LFOTable of
+ * RAM.
+ */
+#define LFO_BANK_TABLES 8
+#define LFO_BANK_PRESETS 8
+
+/**
+ * Longest table or preset name kept, including the terminator.
+ */
+#define LFO_BANK_NAME 16
+
+/**
+ * Most breakpoints read from one CSV table. WAV tables are decimated to
+ * this many points.
+ */
+#define LFO_BANK_POINTS (LFO_TABLE_SIZE + 1)
+
+/**
+ * Settings applied together from a preset file.
+ */
+struct LFOPreset {
+    char name[LFO_BANK_NAME];
+    // Length of each grain fade
+    float fade_ms;
+    // LFOMode, GrainWindowShape and GrainInterpolation
+    uint8_t mode;
+    uint8_t window;
+    uint8_t interpolation;
+};
+
+/**
+ * User wavetables and presets, loaded from a directory on the SD card.
+ *
+ * Every .CSV file in the directory is a table of comma or whitespace
+ * separated values from 0 to 255, spread evenly over one cycle like the
+ * built-in tables. Every .WAV file is a table too, read as one cycle of 8
+ * or 16-bit PCM using only its first channel. Tables are sorted by file
+ * name.
+ *
+ * PRESETS.TXT holds one preset per line:
+ *
+ *   name, fade ms, free|oneshot|retrigger, linear|power|hann,
+ *   none|linear|hermite
+ *
+ * Lines starting with # are ignored.
+ *
+ * Parsing is only done when the directory changes. The results are saved to
+ * LFOBANK.BIN in the same directory, and later boots read that back with
+ * one read per section straight into the bank. It's written as LFOBANK.TMP
+ * and renamed into place, so it's never left half written. The cache is
+ * checked against the name, size and modify time of every source file, so
+ * adding, removing or editing a file rebuilds it. It holds raw structs, so
+ * it also records their sizes, and a build that lays them out differently
+ * rebuilds it.
+ */
+class LFOBank {
+   public:
+    LFOBank(void)
+        : parse_us(0), load_us(0), from_cache(false), _tables(0),
+          _presets(0) {}
+
+    /**
+     * Loads every table and preset in a directory. Call SD.begin() first.
+     * Only call it from setup(), as it blocks on the card.
+     *
+     * @param dir Directory to load, without a trailing slash
+     * @return Whether the directory could be read
+     */
+    bool begin(const char* dir);
+
+    int table_count(void) { return _tables; }
+    const LFOTable& table(int i) { return _table_data[i]; }
+    const char* table_name(int i) { return _table_names[i]; }
+
+    int preset_count(void) { return _presets; }
+    const LFOPreset& preset(int i) { return _preset_data[i]; }
+
+    // Microseconds spent parsing sources, or reading the cache, in the last
+    // begin()
+    uint32_t parse_us;
+    uint32_t load_us;
+    // Whether the last begin() used the cache
+    bool from_cache;
+
+   private:
+    /**
+     * Lists the sources in dir, sorted, and signs their names, sizes and
+     * modify times.
+     */
+    bool scan(const char* dir, uint32_t* signature);
+
+    /**
+     * Reads the cache back. The bank is left as scan() found it unless every
+     * section reads in whole.
+     */
+    bool load_cache(const char* dir, uint32_t signature);
+    void save_cache(const char* dir, uint32_t signature);
+
+    void parse(const char* dir);
+    bool parse_csv(File& file, uint8_t* points, uint32_t* n);
+    bool parse_wav(File& file, uint8_t* points, uint32_t* n);
+    void parse_presets(File& file);
+
+    int _tables;
+    int _presets;
+    char _table_names[LFO_BANK_TABLES][LFO_BANK_NAME];
+    LFOTable _table_data[LFO_BANK_TABLES];
+    LFOPreset _preset_data[LFO_BANK_PRESETS];
+};
+
+#endif
@@ -0,0 +1,61 @@
+#include "cache.h"
+
+void GrainCache::begin(GrainStorage *storage_def, int32_t ring_mask_def) {
+    storage = storage_def;
+    ring_mask = ring_mask_def;
+    misses = 0;
+    invalidate();
+}
+
+void GrainCache::invalidate(void) {
+    for (int i = 0; i < GRAIN_CACHE_PAGES; i++) {
+        tags[i] = -1;
+    }
+}
+
+bool GrainCache::resident(int32_t first, int32_t last, int32_t bias) {
+    int32_t first_page = first >> GRAIN_PAGE_BITS;
+    int32_t last_page = last >> GRAIN_PAGE_BITS;
+    if (last_page - first_page >= GRAIN_CACHE_PAGES) {
+        return false;
+    }
+    for (int32_t p = first_page; p <= last_page; p++) {
+        int32_t page = ((p << GRAIN_PAGE_BITS) & ring_mask) >> GRAIN_PAGE_BITS;
+        if (tags[(p + bias) & (GRAIN_CACHE_PAGES - 1)] != page) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void GrainCache::fetch(int32_t first, int32_t last, int32_t bias,
+                       bool reversed) {
+    if (storage == NULL) {
+        return;
+    }
+    int32_t first_page = first >> GRAIN_PAGE_BITS;
+    int32_t last_page = last >> GRAIN_PAGE_BITS;
+    if (last_page - first_page >= GRAIN_CACHE_PAGES) {
+        last_page = first_page + GRAIN_CACHE_PAGES - 1;
+    }
+    // Pages nearest the read head first, in case the storage falls behind
+    int32_t step = reversed ? -1 : 1;
+    int32_t from = reversed ? last_page : first_page;
+    int32_t count = last_page - first_page + 1;
+    for (int32_t i = 0; i < count; i++) {
+        int32_t p = from + i * step;
+        int32_t page = ((p << GRAIN_PAGE_BITS) & ring_mask) >> GRAIN_PAGE_BITS;
+        int slot = (p + bias) & (GRAIN_CACHE_PAGES - 1);
+        if (tags[slot] == page) {
+            continue;
+        }
+        // Empty the slot first so the audio interrupt never plays a page
+        // that's half overwritten
+        tags[slot] = -1;
+        if (storage->read(page << GRAIN_PAGE_BITS,
+                          data + (slot << GRAIN_PAGE_BITS),
+                          GRAIN_PAGE_SAMPLES)) {
+            tags[slot] = page;
+        }
+    }
+}
@@ -0,0 +1,91 @@
+// cache.h
+
+#include <Arduino.h>
+
+#include "storage.h"
+
+#pragma once
+
+#ifndef M_CACHE_H_
+#define M_CACHE_H_
+
+/**
+ * Samples per cache page, one audio block.
+ */
+#define GRAIN_PAGE_BITS 7
+#define GRAIN_PAGE_SAMPLES (1 << GRAIN_PAGE_BITS)
+
+/**
+ * Pages per cache. A power of two, and the cache must be no bigger than the
+ * ring it caches.
+ */
+#define GRAIN_CACHE_PAGES 16
+#define GRAIN_CACHE_SAMPLES (GRAIN_CACHE_PAGES * GRAIN_PAGE_SAMPLES)
+
+/**
+ * A small on-chip cache of a GrainRing's storage, for a read head playing
+ * from storage that isn't mapped.
+ *
+ * The kernels read the cache with the usual ring indices and a smaller
+ * mask, exactly as if it were the whole ring, as long as every page they
+ * touch is resident. Each grain is given a bias, a number of pages its
+ * start is moved along by, so a ring page goes in the slot it would have in
+ * a ring the size of the cache, plus the bias.
+ *
+ * The read head picks each grain's bias so that the grain's first pages
+ * follow straight on from the slots the grain before it finishes in, and
+ * prefetch() picks the same one for the grain it expects next. The cache
+ * then fills like a queue of the pages the head will play, whatever the
+ * grains' lengths, and the next grain's first pages never share slots with
+ * the last pages of the grain still playing.
+ *
+ * Pages are only ever fetched from loop(). The audio interrupt only checks
+ * whether pages are resident.
+ */
+class GrainCache {
+   public:
+    GrainCache(void) : misses(0), storage(NULL), ring_mask(0) {}
+
+    /**
+     * @param storage_def Storage to fetch pages from
+     * @param ring_mask_def Mask of the ring over the storage
+     */
+    void begin(GrainStorage *storage_def, int32_t ring_mask_def);
+
+    /**
+     * Drops every page, for when the ring has been written since they were
+     * fetched.
+     */
+    void invalidate(void);
+
+    /**
+     * Whether every sample from first to last is resident. The indices may
+     * run past either end of the ring, like the kernels' own indices.
+     *
+     * @param bias Pages the grain is moved along by in the cache
+     */
+    bool resident(int32_t first, int32_t last, int32_t bias);
+
+    /**
+     * Fetches every page from first to last that isn't resident yet. Blocks
+     * on the storage, so only call it from loop().
+     *
+     * @param bias Pages the grain is moved along by in the cache
+     * @param reversed Whether the grain plays backwards, so that the pages
+     *                 from last down are fetched first
+     */
+    void fetch(int32_t first, int32_t last, int32_t bias, bool reversed);
+
+    int16_t data[GRAIN_CACHE_SAMPLES];
+
+    // Blocks the audio interrupt had to skip because a page wasn't resident
+    uint32_t misses;
+
+   private:
+    GrainStorage *storage;
+    int32_t ring_mask;
+    // Ring page in each slot, or -1 while it's empty or being fetched
+    volatile int32_t tags[GRAIN_CACHE_PAGES];
+};
+
+#endif
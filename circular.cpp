@@ -2,147 +2,161 @@
 
 #include <Arduino.h>
 
-void GrainScrubEffectCircular::begin(int16_t *sample_bank_def, int16_t max_len_def) {
-    max_sample_len = max_len_def / 2;
-    length_ms = ((float)max_sample_len / AUDIO_SAMPLE_RATE_EXACT) * 1000;
-    active_buffer = 0;
-    read_head = 0;
-    write_head = 0;
-    playback_rate = 65536;
-    next_playback_rate = 65536;
-    accumulator = 0;
-    reversed = false;
-    next_reversed = false;
-    sample_bank = sample_bank_def;
+// Interpolation reads up to two samples either side of a grain, so the
+// writer stops this far short of a frozen region.
+#define GUARD_MARGIN 2
+
+void GrainScrubEffectCircular::begin(int16_t *sample_bank_def,
+                                     int32_t max_len_def) {
+    ring.begin(sample_bank_def, max_len_def);
+    for (int h = 0; h < GRAIN_SCRUB_HEADS; h++) {
+        heads[h].begin(&ring);
+        heads[h].events = &events;
+        heads[h].index = h;
+    }
 }
 
-void GrainScrubEffectCircular::start() {
-    if (running) {
-        return;
+void GrainScrubEffectCircular::begin(GrainStorage *storage,
+                                     GrainCache *caches) {
+    ring.begin(storage);
+    for (int h = 0; h < GRAIN_SCRUB_HEADS; h++) {
+        GrainCache *cache = NULL;
+        if (caches != NULL && ring.bank == NULL) {
+            cache = &caches[h];
+            cache->begin(storage, ring.mask);
+        }
+        heads[h].begin(&ring, cache);
+        heads[h].events = &events;
+        heads[h].index = h;
     }
-    __disable_irq();
-    active_buffer = active_buffer == 0 ? 1 : 0;
-    read_head = 0;
-    read_head_offset = write_head;
-    running = true;
-    offset = next_offset;
-    length = next_length;
-    playback_rate = next_playback_rate;
-    reversed = next_reversed;
-    __enable_irq();
 }
 
-void GrainScrubEffectCircular::stop() {
-    __disable_irq();
-    running = false;
-    __enable_irq();
+void GrainScrubEffectCircular::service(void) {
+    if (ring.bank != NULL) {
+        return;
+    }
+    ring.flush();
+    for (int h = 0; h < GRAIN_SCRUB_HEADS; h++) {
+        heads[h].prefetch();
+    }
 }
 
 void GrainScrubEffectCircular::update(void) {
     audio_block_t *block;
 
-    if (sample_bank == NULL) {
+    if (ring.getStorage() == NULL) {
         block = receiveReadOnly(0);
         if (block) {
             release(block);
         }
+        block = receiveReadOnly(1);
+        if (block) {
+            release(block);
+        }
         return;
     }
 
+    // Before sync(), so a head starting now latches this block's value
+    modulate();
+
     block = receiveWritable(0);
     if (!block) {
         return;
     }
 
-    if (!running) {
-        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
-            sample_bank[write_head] = block->data[i];
-            sample_bank[write_head + max_sample_len] = block->data[i];
-            write_head++;
-            if (write_head >= max_sample_len) {
-                write_head = 0;
-            }
+    for (int h = 0; h < GRAIN_SCRUB_HEADS; h++) {
+        heads[h].sync();
+    }
+
+    // Record and play up to each event that's due in this block, then apply
+    // it at its exact sample
+    int32_t mix[AUDIO_BLOCK_SAMPLES];
+    bool playing = false;
+    int from = 0;
+    memset(mix, 0, sizeof(mix));
+    const GrainEvent *event;
+    while ((event = events.peek()) != NULL) {
+        int32_t due = event->time - clock;
+        if (due >= AUDIO_BLOCK_SAMPLES) {
+            break;
         }
-    } else {
-        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
-            // Step 1: Write samples to buffer
-            if (active_buffer == 0) {
-                sample_bank[write_head + max_sample_len] = block->data[i];
-            } else {
-                sample_bank[write_head] = block->data[i];
-            }
-            write_head++;
-            if (write_head >= max_sample_len) {
-                write_head = 0;
-            }
+        int at = due > from ? due : from;
+        record(block->data, from, at);
+        playing |= play(mix, from, at);
+        from = at;
+        if (event->target < GRAIN_SCRUB_HEADS) {
+            // Everything before the event is recorded, so the write head is
+            // the oldest sample at that point
+            heads[event->target].apply(*event, ring.write_head);
+        }
+        events.pop();
+    }
+    record(block->data, from, AUDIO_BLOCK_SAMPLES);
+    playing |= play(mix, from, AUDIO_BLOCK_SAMPLES);
+    clock = clock + AUDIO_BLOCK_SAMPLES;
 
-            // Step 2: Figure playback
-            if (!reversed) {
-                accumulator += playback_rate;
-                read_head = accumulator >> 16;
-                if (read_head >= length || read_head < 0) {
-                    accumulator = 0;
-                    read_head = 0;
-                    // Only change the offset/length after a full repeat
-                    offset = next_offset;
-                    length = next_length;
-                    playback_rate = next_playback_rate;
-                    reversed = next_reversed;
-                }
-                // NOTE: Keep an ear out for pops if the length/start
-                // changes during a fade out.
-                int16_t read_index =
-                    (offset + read_head + read_head_offset) %
-                    max_sample_len;
-                if (active_buffer == 1) {
-                    read_index += max_sample_len;
-                }
-                if (length - read_head < 20) {
-                    float fade_out = sample_bank[read_index] *
-                                     ((float)(length - read_head) / 32.0);
-                    block->data[i] = (int16_t)fade_out;
-                } else if (read_head < 20) {
-                    float fade_out =
-                        sample_bank[read_index] * ((float)read_head / 32.0);
-                    block->data[i] = (int16_t)fade_out;
-                } else {
-                    block->data[i] = sample_bank[read_index];
-                }
-            } else {  // Reverse grains
-                accumulator += playback_rate;
-                read_head = length - (accumulator >> 16) - 1;
-                if (read_head < 0 || read_head >= length) {
-                    accumulator = 0;
-                    read_head = length - 1;
-                    // Only change the offset/length after a full repeat
-                    offset = next_offset;
-                    length = next_length;
-                    playback_rate = next_playback_rate;
-                    reversed = next_reversed;
-                }
-                // NOTE: Keep an ear out for pops if the length/start
-                // changes during a fade out.
-                int16_t read_index =
-                    (offset + read_head + read_head_offset) %
-                    max_sample_len;
-                if (active_buffer == 1) {
-                    read_index += max_sample_len;
-                }
-                if (length - read_head < 20) {
-                    float fade_out =
-                        sample_bank[read_index] * ((float)(length - read_head) / 32.0);
-                    block->data[i] = (int16_t)fade_out;
-                } else if (read_head < 20) {
-                    float fade_out =
-                        sample_bank[read_index] * ((float)read_head / 32.0);
-                    block->data[i] = (int16_t)fade_out;
-                } else {
-                    block->data[i] = sample_bank[read_index];
-                }
+    if (playing) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            int32_t sample = mix[i];
+            if (sample > 32767) {
+                sample = 32767;
+            } else if (sample < -32768) {
+                sample = -32768;
             }
+            block->data[i] = sample;
         }
     }
 
     transmit(block);
     release(block);
 }
+
+void GrainScrubEffectCircular::modulate(void) {
+    audio_block_t *block = receiveReadOnly(1);
+    if (block) {
+        modulation = block->data[AUDIO_BLOCK_SAMPLES - 1];
+        release(block);
+    }
+    for (int h = 0; h < GRAIN_SCRUB_HEADS; h++) {
+        heads[h].modulate(modulation);
+    }
+}
+
+void GrainScrubEffectCircular::record(const int16_t *in, int from, int to) {
+    // Keep recording over the oldest audio until the writer reaches the
+    // region frozen by any running head, then pause it
+    int writable = to - from;
+    for (int h = 0; h < GRAIN_SCRUB_HEADS; h++) {
+        GrainHead &head = heads[h];
+        if (head.running) {
+            writable = min(writable, head.guard - GUARD_MARGIN - head.recorded);
+        }
+    }
+    if (writable > 0 && ring.record(in + from, writable)) {
+        for (int h = 0; h < GRAIN_SCRUB_HEADS; h++) {
+            if (heads[h].running) {
+                heads[h].recorded += writable;
+            }
+        }
+    }
+}
+
+bool GrainScrubEffectCircular::play(int32_t *mix, int from, int to) {
+    int16_t out[AUDIO_BLOCK_SAMPLES];
+    bool playing = false;
+    if (to <= from) {
+        return false;
+    }
+    for (int h = 0; h < GRAIN_SCRUB_HEADS; h++) {
+        GrainHead &head = heads[h];
+        if (!head.running) {
+            continue;
+        }
+        head.play(out, to - from);
+        for (int i = 0; i < to - from; i++) {
+            mix[from + i] += out[i];
+        }
+        playing = true;
+    }
+    return playing;
+}
@@ -2,193 +2,130 @@
 
 #include <Audio.h>
 
+#include "events.h"
+#include "head.h"
+#include "ring.h"
+
 #pragma once
 
+/**
+ * Number of independent read heads over the ring.
+ */
+#define GRAIN_SCRUB_HEADS 4
+
 /**
  * An adaptation of John-Mike Reed's granular effect in the Teensy Audio
  * Library.
  *
- * TODO: Currently, this effect begins writing to the buffer only when
- * triggered, which means there's a slight delay before it begins repeating,
- * which may not be very musical. By recording to the buffer all the time using
- * a circular buffer, you can begin playback instantly, however it introduces a
- * potential issue of hold length. If you were to hold a freeze for longer than
- * the maximum buffer length, then you would begin to overwrite it with unwanted
- * results.
+ * Unlike GrainScrubEffect, this records into a ring all the time, so a freeze
+ * can begin playback instantly from audio that came before the trigger.
  *
- * To make it work correctly, you'll need two buffers that are used alternately.
- * The downside of this is that the effect would take up twice the amount of
- * memory as the current granular effect.
+ * The whole ring is used for the freeze. The ring is the buffer rounded
+ * down to a power of two, so that's the longest freeze: a 20000 sample
+ * buffer gives 16384 samples, about 371 ms rather than the 453 ms of the
+ * whole buffer.
+ *
+ * One ring is shared by up to GRAIN_SCRUB_HEADS independent read heads, each
+ * with its own offset, length, speed and direction, so freezes from
+ * different triggers can layer without a buffer each. Running heads are
+ * mixed inside the effect.
+ *
+ * While any head is frozen, the writer keeps recording over the oldest audio
+ * in the ring, up to the earliest start position a running head has used
+ * since it was triggered, and then pauses. Holding a freeze longer than the
+ * ring therefore never overwrites a frozen grain, and start positions behind
+ * the writer are pushed forward past it.
+ *
+ * The second input is a modulation source such as ModulationLFO, from 0 to
+ * 32767. Its last sample is read once per block and handed to any head set
+ * to follow it with one of the GrainHead::modulate*() calls. Nothing needs
+ * to be connected to it otherwise.
  *
  * See https://github.com/PaulStoffregen/Audio/blob/master/effect_granular.h
  */
 class GrainScrubEffectCircular : public AudioStream {
    public:
-    GrainScrubEffectCircular(void) : AudioStream(1, inputQueueArray) {}
+    GrainScrubEffectCircular(void)
+        : AudioStream(2, inputQueueArray), modulation(0), clock(0) {}
 
     /**
      * Similar to the granular effect, initialize with an int16_t audio buffer
      * and the maximum length of the buffer.
      *
+     * The ring is rounded down to a power of two, so a max_len_def of 2^n
+     * wastes no memory, and anything past it is never recorded or frozen.
+     *
      * @param sample_bank_def Audio buffer array of int16_t
      * @param max_len_def Length of sample_bank_def
      */
-    void begin(int16_t *sample_bank_def, int16_t max_len_def);
+    void begin(int16_t *sample_bank_def, int32_t max_len_def);
 
     /**
-     * Calculates a integer playback rate from a float value.
+     * Initializes the ring over any GrainStorage, such as external PSRAM or a
+     * loop saved to SerialFlash. Storage that isn't mapped needs a cache for
+     * each head, and service() to be called from loop().
      *
-     * @param ratio Speed of playback where 1.0 is the standard sample rate
+     * @param storage Storage for the ring
+     * @param caches Array of GRAIN_SCRUB_HEADS caches, or NULL if the storage
+     *               is mapped
      */
-    void setSpeed(float ratio) {
-        if (ratio < -4.0) {
-            ratio = -4.0;
-        } else if (ratio < 0 && ratio >= -0.125) {
-            ratio = -0.125;
-        } else if (ratio < 0.125)
-            ratio = 0.125;
-        else if (ratio > 4.0)
-            ratio = 4.0;
-        next_playback_rate = ratio * 65536.0 + 0.499;
-    }
+    void begin(GrainStorage *storage, GrainCache *caches = NULL);
 
     /**
-     * Reverses the current playback speed.
+     * Writes recorded audio out to storage that isn't mapped and prefetches
+     * the next pages of every running head. Call it from loop() as often as
+     * possible; it does nothing for mapped storage.
      */
-    void reverse(void) { next_reversed = true; }
-    void forward(void) { next_reversed = false; }
+    void service(void);
 
     /**
-     * Sets the start position based on a millisecond value. Useful when
-     * the position needs to be quantized to a beat.
-     *
-     * @param ms Milliseconds from the start of the delay sample
+     * @param index Read head from 0 to GRAIN_SCRUB_HEADS - 1
      */
-    void setStartMs(float ms) {
-        if (ms < 0.0) {
-            ms = 0.0;
-        } else if (ms > length_ms) {
-            ms = length_ms - 1.0;
-        }
-        int16_t new_offset = ms * AUDIO_SAMPLE_RATE_EXACT * 0.001;
-        next_offset = new_offset;
-        if (ideal_length + next_offset > max_sample_len) {
-            next_length = max_sample_len - next_offset;
-        } else {
-            next_length = ideal_length;
+    GrainHead *head(int index) {
+        if (index < 0 || index >= GRAIN_SCRUB_HEADS) {
+            return NULL;
         }
+        return &heads[index];
     }
 
     /**
-     * Sets the start position based on a fractional value based
-     * on the full delay buffer length.
-     *
-     * @param pos Fraction of the max delay time
+     * The capture ring this effect records into, so other grain engines
+     * such as GrainCloudEffect can play from the same audio.
      */
-    void setStartPos(float pos) {
-        if (pos < 0.0)
-            pos = 0.0;
-        else if (pos > 0.99)
-            pos = 0.99;
-        int16_t new_offset = pos * max_sample_len;
-        next_offset = new_offset;
-        if (ideal_length + next_offset > max_sample_len) {
-            next_length = max_sample_len - next_offset - 1;
-        } else {
-            next_length = ideal_length;
-        }
-    }
+    GrainRing *getRing(void) { return &ring; }
 
     /**
-     * Sets the length based on a millisecond value. Useful when
-     * the length needs to be quantized to a beat.
-     *
-     * @param ms Millisecond length of the sample playback
+     * Sample time of the first sample of the next block, for scheduling
+     * events on the heads. Wraps around every 27 hours.
      */
-    void setLengthMs(float ms) {
-        if (ms < 1.0) {
-            ms = 1.0;
-        } else if (ms > length_ms) {
-            ms = length_ms;
-        }
-        int16_t new_length = (ms * AUDIO_SAMPLE_RATE_EXACT * 0.001) - offset;
-        if (new_length < 50) {
-            new_length = max_sample_len - offset - 1;
-        }
-        next_length = new_length;
+    uint32_t now(void) { return clock; }
 
-        // Ideal length keeps the true length, even if the start time
-        ideal_length = next_length;
-    }
+    virtual void update(void);
 
+   private:
     /**
-     * Sets the start position based on a fractional value based
-     * on the full delay buffer length.
-     *
-     * @param pos Fraction of the max delay time
+     * Records samples from to to of the input into the ring, as far as the
+     * running heads allow.
      */
-    void setLengthPos(float pos) {
-        if (pos < 0.01)
-            pos = 0.01;
-        else if (pos > 1.0)
-            pos = 1.0;
-        int16_t new_length = (max_sample_len * pos) - offset;
-        if (new_length < 50) {
-            new_length = max_sample_len - offset - 1;
-        }
-        next_length = new_length;
-        ideal_length = next_length;
-    }
+    void record(const int16_t *in, int from, int to);
 
-    void debug(void) {
-        Serial.print("Max Sample Length: ");
-        Serial.println(max_sample_len);
-        Serial.print("Accumulator: ");
-        Serial.println(accumulator >> 16);
-        Serial.print("Write Head: ");
-        Serial.println(write_head);
-        Serial.print("Read Head: ");
-        Serial.println(read_head);
-        Serial.print("Offset: ");
-        Serial.print(next_offset);
-        Serial.print(" -> ");
-        Serial.println(offset);
-        Serial.print("Length: ");
-        Serial.print(next_length);
-        Serial.print(" -> ");
-        Serial.println(length);
-        Serial.print("Playback Rate: ");
-        Serial.print(next_playback_rate);
-        Serial.print(" -> ");
-        Serial.println(playback_rate);
-        Serial.print("Reversed: ");
-        Serial.print(next_reversed);
-        Serial.print(" -> ");
-        Serial.println(reversed);
-    }
+    /**
+     * Plays samples from to to of every running head into mix.
+     *
+     * @return Whether any head played
+     */
+    bool play(int32_t *mix, int from, int to);
 
-    void start(void);
-    void stop(void);
-    virtual void update(void);
+    /**
+     * Takes this block's value from the modulation input.
+     */
+    void modulate(void);
 
-   private:
-    audio_block_t *inputQueueArray[1];
-    int16_t *sample_bank;
-    int32_t playback_rate;
-    int32_t next_playback_rate;
-    uint32_t accumulator;
-    int16_t max_sample_len;
-    int16_t write_head;
-    int16_t read_head;
-    int16_t read_head_offset;
-    int16_t active_buffer;
-    int16_t offset;
-    int16_t length;
-    int16_t ideal_length;
-    int16_t next_length;
-    int16_t next_offset;
-    float length_ms;
-    bool running;
-    bool reversed;
-    bool next_reversed;
+    audio_block_t *inputQueueArray[2];
+    GrainRing ring;
+    GrainHead heads[GRAIN_SCRUB_HEADS];
+    GrainEventQueue events;
+    // Held while nothing is transmitted to the modulation input
+    int32_t modulation;
+    volatile uint32_t clock;
 };
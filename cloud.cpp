@@ -0,0 +1,156 @@
+#include "cloud.h"
+
+#include <Arduino.h>
+
+// Margin between a grain and the writer: one block, since the ring is
+// recorded a block at a time, plus the interpolation taps.
+#define WRITER_MARGIN (AUDIO_BLOCK_SAMPLES + 2)
+
+void GrainCloudEffect::begin(GrainRing *ring_def) {
+    ring = ring_def;
+    window = grain_window(GRAIN_WINDOW_HANN);
+    seed = 0x2545F491;
+    voices = GRAIN_CLOUD_VOICES;
+    spawn_interval = 0;
+    spawn_countdown = 0;
+    playback_rate = 65536;
+    gain = 32767;
+    offset = 0;
+    length = ring->size / 8;
+    jitter = 0;
+    jitter_depth = 0;
+    interpolation = GRAIN_INTERP_LINEAR;
+    for (int i = 0; i < GRAIN_CLOUD_VOICES; i++) {
+        pool[i].active = false;
+    }
+}
+
+void GrainCloudEffect::spawn(int16_t delay) {
+    Voice *voice = NULL;
+    for (int i = 0; i < voices; i++) {
+        if (!pool[i].active) {
+            voice = &pool[i];
+            break;
+        }
+    }
+    if (voice == NULL || length < 2) {
+        return;
+    }
+
+    // The writer keeps overwriting the oldest audio while the grain plays,
+    // so the grain has to start past everything it will overwrite in the
+    // grain's lifetime. Slow grains live longer, so they're shortened to fit.
+    int32_t grain_length = length;
+    int32_t max_length =
+        ((int64_t)(ring->size - WRITER_MARGIN) * playback_rate) /
+        (playback_rate + 65536);
+    if (grain_length > max_length) {
+        grain_length = max_length;
+    }
+    int32_t lifetime =
+        (((uint64_t)grain_length << 16) / playback_rate) + WRITER_MARGIN;
+
+    int32_t start = offset;
+    if (jitter > 0) {
+        start += (int32_t)(((uint64_t)next_random() * (2 * jitter + 1)) >> 32) -
+                 jitter;
+    }
+    if (start > ring->size - grain_length) {
+        start = ring->size - grain_length;
+    }
+    if (start < lifetime) {
+        start = lifetime;
+    }
+
+    GrainParams &grain = voice->grain;
+    grain.bank = ring->bank;
+    grain.mask = ring->mask;
+    grain.start = ring->write_head + start;
+    grain.length = grain_length;
+    grain.rate = playback_rate;
+    grain.fade = grain_length / 2;
+    grain.window = window;
+    grain.window_step = grain_window_step(grain.fade);
+    grain.reversed = false;
+    grain.interpolation = interpolation;
+    voice->accumulator = 0;
+    voice->position = 0;
+    voice->delay = delay;
+    voice->active = true;
+}
+
+void GrainCloudEffect::update(void) {
+    audio_block_t *block = receiveReadOnly(0);
+    if (block) {
+        modulation = block->data[AUDIO_BLOCK_SAMPLES - 1];
+        release(block);
+    }
+    if (ring == NULL || ring->bank == NULL) {
+        return;
+    }
+    int32_t depth = jitter_depth;
+    if (depth > 0) {
+        int32_t value = modulation < 0 ? 0 : modulation;
+        jitter = ((int64_t)value * depth) >> 15;
+    }
+
+    // Spawn this block's grains at the exact sample they're due, spacing
+    // them between a half and one and a half intervals apart
+    if (spawn_interval > 0) {
+        while (spawn_countdown < AUDIO_BLOCK_SAMPLES) {
+            spawn(spawn_countdown);
+            spawn_countdown +=
+                spawn_interval / 2 +
+                (((uint64_t)next_random() * spawn_interval) >> 32);
+        }
+        spawn_countdown -= AUDIO_BLOCK_SAMPLES;
+    }
+
+    int32_t mix[AUDIO_BLOCK_SAMPLES];
+    int16_t out[AUDIO_BLOCK_SAMPLES];
+    bool playing = false;
+    memset(mix, 0, sizeof(mix));
+    for (int v = 0; v < GRAIN_CLOUD_VOICES; v++) {
+        Voice &voice = pool[v];
+        if (!voice.active) {
+            continue;
+        }
+        int from = voice.delay;
+        int i = from;
+        voice.delay = 0;
+        while (i < AUDIO_BLOCK_SAMPLES) {
+            if (grain_finished(voice.grain, voice.accumulator,
+                               voice.position)) {
+                // Retire the voice, it's free to spawn again next block
+                voice.active = false;
+                break;
+            }
+            i += grain_play_span<true>(out + i, AUDIO_BLOCK_SAMPLES - i,
+                                       voice.grain, voice.accumulator,
+                                       voice.position);
+        }
+        for (int j = from; j < i; j++) {
+            mix[j] += out[j];
+        }
+        playing = true;
+    }
+    if (!playing) {
+        return;
+    }
+
+    block = allocate();
+    if (!block) {
+        return;
+    }
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        int32_t sample = ((int64_t)mix[i] * gain) >> 15;
+        if (sample > 32767) {
+            sample = 32767;
+        } else if (sample < -32768) {
+            sample = -32768;
+        }
+        block->data[i] = sample;
+    }
+    transmit(block);
+    release(block);
+}
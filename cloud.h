@@ -0,0 +1,208 @@
+// cloud.h
+
+#include <Audio.h>
+
+#include "grain.h"
+#include "player.h"
+#include "ring.h"
+
+#pragma once
+
+/**
+ * Maximum number of grains a cloud can play at once. Every voice costs at
+ * most one kernel pass over a block (up to three spans: fade-in, body and
+ * fade-out) plus one add per sample, so the worst case CPU of the cloud is
+ * this many times a single GrainScrubEffectCircular playing a grain.
+ */
+#define GRAIN_CLOUD_VOICES 8
+
+/**
+ * Polyphonic grain cloud. Spawns short windowed grains from a GrainRing that
+ * another effect records into, usually GrainScrubEffectCircular::getRing(),
+ * so the cloud needs no memory of its own beyond a fixed pool of voices.
+ *
+ * Start position, length and speed mean the same as they do on the scrub
+ * effects and are sampled by each grain as it spawns. Density sets how many
+ * grains start per second, and jitter scatters their start positions. When
+ * every voice is busy a new grain is dropped rather than stealing a voice.
+ *
+ * The input is a modulation source such as ModulationLFO, from 0 to 32767,
+ * that jitter can follow with modulateJitter(). Its last sample is read once
+ * per block.
+ */
+class GrainCloudEffect : public AudioStream {
+   public:
+    GrainCloudEffect(void)
+        : AudioStream(1, inputQueueArray), ring(NULL), modulation(0) {}
+
+    /**
+     * Call before any of the setters, which scale to the ring.
+     *
+     * @param ring_def Capture ring to play grains from
+     */
+    void begin(GrainRing *ring_def);
+
+    /**
+     * Limits the number of voices below GRAIN_CLOUD_VOICES, to trade
+     * density for CPU.
+     *
+     * @param count Number of voices
+     */
+    void setVoices(int count) {
+        if (count < 0) {
+            count = 0;
+        } else if (count > GRAIN_CLOUD_VOICES) {
+            count = GRAIN_CLOUD_VOICES;
+        }
+        voices = count;
+    }
+
+    /**
+     * @param grains_per_second Average number of grains spawned per second,
+     *                          or 0 to stop spawning
+     */
+    void setDensity(float grains_per_second) {
+        if (grains_per_second <= 0.0) {
+            spawn_interval = 0;
+            return;
+        }
+        if (grains_per_second > 1000.0) {
+            grains_per_second = 1000.0;
+        }
+        spawn_interval = AUDIO_SAMPLE_RATE_EXACT / grains_per_second;
+    }
+
+    /**
+     * Scatters the start position of each grain by up to this fraction of
+     * the ring in either direction.
+     *
+     * @param pos Fraction of the ring
+     */
+    void setJitter(float pos) {
+        if (pos < 0.0) {
+            pos = 0.0;
+        } else if (pos > 1.0) {
+            pos = 1.0;
+        }
+        // Stops the audio interrupt setting it first
+        jitter_depth = 0;
+        jitter = pos * ring->size;
+    }
+
+    /**
+     * Makes jitter follow the modulation input, until setJitter() is called
+     * again.
+     *
+     * @param pos Fraction of the ring to scatter by when the input is at
+     *            its highest
+     */
+    void modulateJitter(float pos) {
+        if (pos < 0.0) {
+            pos = 0.0;
+        } else if (pos > 1.0) {
+            pos = 1.0;
+        }
+        jitter_depth = pos * ring->size;
+    }
+
+    /**
+     * Calculates a integer playback rate from a float value.
+     *
+     * @param ratio Speed of playback where 1.0 is the standard sample rate
+     */
+    void setSpeed(float ratio) { playback_rate = grain_speed_rate(ratio); }
+
+    /**
+     * Sets the start position based on a fractional value based
+     * on the full ring length.
+     *
+     * @param pos Fraction of the max delay time
+     */
+    void setStartPos(float pos) {
+        offset = grain_start_offset(pos, ring->size);
+    }
+
+    /**
+     * Sets the length based on a fractional value based
+     * on the full ring length.
+     *
+     * @param pos Fraction of the max delay time
+     */
+    void setLengthPos(float pos) {
+        length = grain_end_length(pos, ring->size, offset);
+    }
+
+    /**
+     * Sets the length based on a millisecond value.
+     *
+     * @param ms Millisecond length of each grain
+     */
+    void setLengthMs(float ms) {
+        int32_t new_length = ms * AUDIO_SAMPLE_RATE_EXACT * 0.001;
+        if (new_length < 50) {
+            new_length = 50;
+        } else if (new_length > ring->size / 2) {
+            new_length = ring->size / 2;
+        }
+        length = new_length;
+    }
+
+    void setInterpolation(GrainInterpolation mode) { interpolation = mode; }
+
+    /**
+     * Output gain applied to the sum of all voices.
+     *
+     * @param n Gain from 0.0 to 1.0
+     */
+    void amplitude(float n) {
+        if (n < 0.0) {
+            n = 0.0;
+        } else if (n > 1.0) {
+            n = 1.0;
+        }
+        gain = n * 32767.0;
+    }
+
+    virtual void update(void);
+
+   private:
+    struct Voice {
+        GrainParams grain;
+        uint32_t accumulator;
+        int32_t position;
+        // Samples into the next block before the grain starts
+        int16_t delay;
+        bool active;
+    };
+
+    void spawn(int16_t delay);
+
+    /**
+     * xorshift32, cheap enough to call per grain in the audio interrupt.
+     */
+    uint32_t next_random(void) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+
+    audio_block_t *inputQueueArray[1];
+    GrainRing *ring;
+    Voice pool[GRAIN_CLOUD_VOICES];
+    const int16_t *window;
+    uint32_t seed;
+    int32_t spawn_interval;
+    int32_t spawn_countdown;
+    int32_t playback_rate;
+    int32_t gain;
+    int32_t offset;
+    int32_t length;
+    int32_t jitter;
+    // Jitter at the highest modulation, or 0 when it isn't modulated
+    volatile int32_t jitter_depth;
+    // Held while nothing is transmitted to the input
+    int32_t modulation;
+    int voices;
+    GrainInterpolation interpolation;
+};
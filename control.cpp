@@ -8,154 +8,266 @@
 ControlState::ControlState() {
     _ms = millis();
     _last_ms = _ms;
-    for (int i = 0; i < MAX_BUTTONS; i++) {
-        _buttons[i] = NULL;
-    }
-    for (int i = 0; i < MAX_DIGITAL_LEDS; i++) {
-        _leds[i] = NULL;
-    }
-    for (int i = 0; i < MAX_POTS; i++) {
-        _pots[i] = NULL;
-    }
-    for (int i = 0; i < MAX_GTLS; i++) {
-        _gtls[i] = NULL;
+    for (int i = 0; i < MAX_CVS; i++) {
+        _cvs[i] = -1;
     }
 };
 
+void ControlState::begin() { _scanner.begin(); };
+
 bool ControlState::loop() {
     _ms = millis();
     if (_ms - _last_ms >= CONTROL_RATE) {
         _last_ms = _ms;
-        for (int i = 0; i < MAX_BUTTONS; i++) {
-            if (_buttons[i] != NULL) {
-                _buttons[i]->loop(_ms);
-            }
+        for (int i = 0; i < _buttons.count(); i++) {
+            _buttons[i].loop(_ms);
         }
-        for (int i = 0; i < MAX_POTS; i++) {
-            if (_pots[i] != NULL) {
-                _pots[i]->loop(_ms);
-            }
+        for (int i = 0; i < _pots.count(); i++) {
+            _pots[i].loop(_ms);
         }
-        for (int i = 0; i < MAX_DIGITAL_LEDS; i++) {
-            if (_leds[i] != NULL) {
-                _leds[i]->loop(_ms);
-            }
-        }
-        for (int i = 0; i < MAX_GTLS; i++) {
-            if (_gtls[i] != NULL) {
-                _gtls[i]->loop(_ms);
-            }
+        for (int i = 0; i < _leds.count(); i++) {
+            _leds[i].loop(_ms);
         }
         return true;
     }
     return false;
 };
 
+bool ControlState::poll_gates() {
+    unsigned long ms = millis();
+    bool changed = false;
+    for (int i = 0; i < _gtls.count(); i++) {
+        _gtls[i].loop(ms);
+        changed |= _gtls[i].high || _gtls[i].low;
+    }
+    for (int i = 0; i < _clocks.count(); i++) {
+        _clocks[i].loop(ms);
+    }
+    return changed;
+};
+
 void ControlState::register_button(int index, int pin) {
-    if (index >= MAX_BUTTONS) {
-        return;
+    Button* btn = _buttons.add(index, pin);
+    if (btn != NULL) {
+        btn->setup();
     }
-    Button* btn = new Button(pin);
-    _buttons[index] = btn;
-    btn->setup();
 };
 
 void ControlState::register_pot(int index, int pin) {
-    if (index >= MAX_POTS) {
+    Potentiometer* pot = _pots.add(index, pin);
+    if (pot == NULL) {
+        return;
+    }
+    int channel = _scanner.add(pin);
+    if (channel >= 0) {
+        pot->attach(&_scanner, channel);
+    }
+};
+
+void ControlState::register_cv(int index, int pin) {
+    if (index >= MAX_CVS) {
         return;
     }
-    Potentiometer* pot = new Potentiometer(pin);
-    _pots[index] = pot;
+    _cvs[index] = _scanner.add(pin, true);
 };
 
 void ControlState::register_led(int index, int pin) {
-    if (index >= MAX_DIGITAL_LEDS) {
-        return;
+    DigitalLed* led = _leds.add(index, pin);
+    if (led != NULL) {
+        led->setup();
     }
-    DigitalLed* led = new DigitalLed(pin);
-    _leds[index] = led;
-    led->setup();
 };
 
 void ControlState::register_gtl(int index, int input_pin, int led_pin) {
-    if (index >= MAX_GTLS) {
-        return;
+    GateTrigger* gtl = _gtls.add(index, input_pin, led_pin);
+    if (gtl != NULL) {
+        gtl->setup();
     }
-    GateTrigger* gtl = new GateTrigger(input_pin, led_pin);
-    _gtls[index] = gtl;
-    gtl->setup();
 };
 
-Button* ControlState::get_button(int index) {
-    if (index >= MAX_BUTTONS) {
-        return NULL;
+void ControlState::register_clock(int pin) {
+    ClockInput* clock = _clocks.add(0, pin);
+    if (clock != NULL) {
+        clock->setup();
     }
-    return _buttons[index];
 };
 
+Button* ControlState::get_button(int index) { return _buttons.get(index); };
+
 Potentiometer* ControlState::get_potentiometer(int index) {
-    if (index >= MAX_POTS) {
-        return NULL;
-    }
-    return _pots[index];
+    return _pots.get(index);
 };
 
-DigitalLed* ControlState::get_led(int index) {
-    if (index >= MAX_DIGITAL_LEDS) {
-        return NULL;
+int ControlState::get_cv(int index) {
+    if (index >= MAX_CVS || _cvs[index] < 0) {
+        return 0;
     }
-    return _leds[index];
+    return _scanner.latest(_cvs[index]);
 };
 
-GateTrigger* ControlState::get_gtl(int index) {
-    if (index >= MAX_GTLS) {
-        return NULL;
-    }
-    return _gtls[index];
-};
+DigitalLed* ControlState::get_led(int index) { return _leds.get(index); };
+
+GateTrigger* ControlState::get_gtl(int index) { return _gtls.get(index); };
+
+static ClockInput* clock_input = NULL;
+
+static void clock_isr(void) { clock_input->capture(); }
 
 ClockInput::ClockInput(int pin) {
     _pin = pin;
     _state = 1;
-    _last_state = 1;
-    _duration_total = 0.0;
-    _durations = 0;
+    _interrupt = false;
+    beat = false;
+    reset();
 };
 
-void ClockInput::setup() { pinMode(_pin, INPUT_PULLUP); };
+void ClockInput::setup() {
+    pinMode(_pin, INPUT_PULLUP);
+    if (!_interrupt && clock_input == NULL) {
+        clock_input = this;
+        attachInterrupt(digitalPinToInterrupt(_pin), clock_isr, CHANGE);
+        _interrupt = true;
+    }
+};
 
 void ClockInput::reset() {
     is_clocked = false;
     clock_interval = 0.0;
-    _duration_total = 0.0;
-    _durations = 0;
+    _beats = 0;
+    _outliers = 0;
+    _period_us = 0.0;
+    _last_us = 0;
+    _beat_us = 0;
+    _interval = 0;
+    for (int i = 0; i < CLOCK_RELOCK; i++) {
+        _intervals[i] = 0;
+    }
 }
 
-void ClockInput::loop(unsigned long ms) {
-    int state = digitalRead(_pin);
-    unsigned long duration = ms - _last_ms;
+void ClockInput::capture() { _edges.push(micros(), digitalRead(_pin)); }
 
-    if (_state == 0 && state == 1 && duration < BTN_DEBOUNCE) {
-        return;
+void ClockInput::loop(unsigned long) {
+    uint32_t now = micros();
+    beat = false;
+
+    if (!_interrupt) {
+        int state = digitalRead(_pin);
+        if (state != _state) {
+            _edges.push(now, state);
+        }
     }
 
-    _last_state = _state;
-    _state = state;
+    const GateEdge* edge;
+    while ((edge = _edges.peek()) != NULL) {
+        // Beats are the input going low, as it's pulled up
+        if (edge->state == 0 && _state == 1 &&
+            (_beats == 0 || edge->us - _last_us >= CLOCK_DEBOUNCE_US)) {
+            clock(edge->us);
+            beat = true;
+        }
+        _state = edge->state;
+        _edges.pop();
+    }
 
-    down = _state == 0;
-    pressed = _last_state == 1 && down;
-    if (pressed) {
-        if (is_clocked) {
-            clock_interval = ms - _last_ms;
-        } else {
+    uint32_t timeout = max(CLOCK_TIMEOUT * 1000.0f, _period_us * 2);
+    if (_beats > 0 && now - _last_us > timeout) {
+        reset();
+    }
+};
+
+void ClockInput::clock(uint32_t us) {
+    uint32_t interval = us - _last_us;
+    _last_us = us;
+    if (_beats > 0) {
+        _intervals[_interval] = interval;
+        _interval = (_interval + 1) % CLOCK_RELOCK;
+    }
+
+    if (_beats < 2) {
+        // The first interval is the first guess at the period
+        if (_beats == 1) {
+            _period_us = interval;
             is_clocked = true;
         }
-        _last_ms = ms;
-    } else if (duration > CLOCK_TIMEOUT) {
-        is_clocked = false;
+        _beat_us = us;
+        _beats++;
+    } else {
+        float since = (int32_t)(us - _beat_us);
+        int n = lroundf(since / _period_us);
+        float error = since - n * _period_us;
+        // A beat a few periods on stands in for missed pulses, unless the
+        // pulses in between came at the wrong time, as a slower tempo that
+        // lines up with every few beats would
+        if (n >= 1 && fabsf(error) <= CLOCK_OUTLIER * _period_us &&
+            (n == 1 || _outliers == 0)) {
+            _outliers = 0;
+            _beat_us += (int32_t)lroundf(n * _period_us +
+                                         CLOCK_PHASE_GAIN * error);
+            _period_us += CLOCK_PERIOD_GAIN * error / n;
+        } else if (++_outliers >= CLOCK_RELOCK) {
+            // The tempo has changed, so start again from the median of the
+            // latest intervals
+            uint32_t sorted[CLOCK_RELOCK];
+            for (int i = 0; i < CLOCK_RELOCK; i++) {
+                int j = i;
+                while (j > 0 && sorted[j - 1] > _intervals[i]) {
+                    sorted[j] = sorted[j - 1];
+                    j--;
+                }
+                sorted[j] = _intervals[i];
+            }
+            _period_us = sorted[CLOCK_RELOCK / 2];
+            _beat_us = us;
+            _outliers = 0;
+        }
     }
+    clock_interval = _period_us * 0.001;
 };
 
+uint32_t ClockInput::next_beat_us(uint32_t now) {
+    if (!is_clocked) {
+        return now;
+    }
+    float since = (int32_t)(now - _beat_us);
+    return _beat_us + (int32_t)(ceilf(since / _period_us) * _period_us);
+}
+
+float ClockInput::phase(uint32_t now) {
+    if (!is_clocked) {
+        return 0.0;
+    }
+    float beats = (int32_t)(now - _beat_us) / _period_us;
+    return beats - floorf(beats);
+}
+
+float ClockInput::quantize_ms(float ms) {
+    if (!is_clocked || ms <= 0.0) {
+        return ms;
+    }
+    int octaves = lroundf(log2f(ms / clock_interval));
+    octaves = constrain(octaves, -CLOCK_QUANTIZE_OCTAVES,
+                        CLOCK_QUANTIZE_OCTAVES);
+    return ldexpf(clock_interval, octaves);
+}
+
+float ClockInput::snap_ms(float ms, int division) {
+    if (!is_clocked || division <= 0) {
+        return ms;
+    }
+    float step = clock_interval / division;
+    return roundf(ms / step) * step;
+}
+
+float ClockInput::quantize_speed(float ratio) {
+    if (!is_clocked || ratio <= 0.0) {
+        return ratio;
+    }
+    int octaves = lroundf(log2f(ratio));
+    octaves = constrain(octaves, -CLOCK_QUANTIZE_OCTAVES,
+                        CLOCK_QUANTIZE_OCTAVES);
+    return ldexpf(1.0, octaves);
+}
+
 Button::Button(int pin) {
     _pin = pin;
     _state = 1;
@@ -198,53 +310,82 @@ void Button::loop(unsigned long ms) {
     }
 };
 
+// Middle band of the sorted window that's averaged
+#define POT_BAND_BOTTOM max(POT_SMOOTH_OUTLIER_LOW, 1)
+#define POT_BAND_TOP min(POT_SMOOTH_OUTLIER_HIGH, POT_SMOOTH_SAMPLES - 1)
+
+static inline bool in_band(int index) {
+    return index >= POT_BAND_BOTTOM && index < POT_BAND_TOP;
+}
+
 Potentiometer::Potentiometer(int pin) {
     _pin = pin;
+    _scanner = NULL;
+    _channel = -1;
     value = 0;
     _smooth = 0;
+    _band_total = 0;
     for (int i = 0; i < POT_SMOOTH_SAMPLES; i++) {
         _samples[i] = 0;
+        _sorted[i] = 0;
     }
 };
 
-void Potentiometer::loop(unsigned long ms) {
-    int curr = analogRead(_pin);
-    int j, k, temp, top, bottom;
-    long total;
-    static int sorted[POT_SMOOTH_SAMPLES];
-    boolean done;
-
-    _smooth = (_smooth + 1) % POT_SMOOTH_SAMPLES;
-    _samples[_smooth] = curr;
+void Potentiometer::attach(AnalogScanner* scanner, int channel) {
+    _scanner = scanner;
+    _channel = channel;
+}
 
-    for (j = 0; j < POT_SMOOTH_SAMPLES; j++) {
-        sorted[j] = _samples[j];
+void Potentiometer::replace(int old_value, int new_value) {
+    // Any copy of the old value will do, so take the first
+    int lo = 0;
+    int hi = POT_SMOOTH_SAMPLES - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        if (_sorted[mid] < old_value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
     }
 
-    done = false;
-    while (!done) {
-        done = true;
-        for (j = 0; j < (POT_SMOOTH_SAMPLES - 1); j++) {
-            if (sorted[j] > sorted[j + 1]) {
-                temp = sorted[j + 1];
-                sorted[j + 1] = sorted[j];
-                sorted[j] = temp;
-                done = false;
-            }
+    int j = lo;
+    if (in_band(j)) {
+        _band_total -= old_value;
+    }
+    // Shift the readings between the old slot and the new one along by
+    // one, moving them between the band and the outliers as they cross
+    if (new_value > old_value) {
+        while (j + 1 < POT_SMOOTH_SAMPLES && _sorted[j + 1] < new_value) {
+            int moved = _sorted[j + 1];
+            _sorted[j] = moved;
+            _band_total += (in_band(j) - in_band(j + 1)) * (long)moved;
+            j++;
+        }
+    } else {
+        while (j > 0 && _sorted[j - 1] > new_value) {
+            int moved = _sorted[j - 1];
+            _sorted[j] = moved;
+            _band_total += (in_band(j) - in_band(j - 1)) * (long)moved;
+            j--;
         }
     }
+    _sorted[j] = new_value;
+    if (in_band(j)) {
+        _band_total += new_value;
+    }
+}
 
-    bottom = max(POT_SMOOTH_OUTLIER_LOW, 1);
-    top = min(POT_SMOOTH_OUTLIER_HIGH, POT_SMOOTH_SAMPLES - 1);
-    k = 0;
-    total = 0;
+void Potentiometer::loop(unsigned long) {
+    int curr =
+        _scanner != NULL ? _scanner->latest(_channel) : analogRead(_pin);
 
-    for (j = bottom; j < top; j++) {
-        total += sorted[j];
-        k++;
-    }
+    _smooth = (_smooth + 1) % POT_SMOOTH_SAMPLES;
+    int old_value = _samples[_smooth];
+    _samples[_smooth] = curr;
+    replace(old_value, curr);
 
-    value = total / k;
+    value = _band_total / (POT_BAND_TOP - POT_BAND_BOTTOM);
     value = map(value, 50, 4000, 0, 4095);
     if (value < 0) {
         value = 0;
@@ -294,49 +435,103 @@ void DigitalLed::toggle() {
 
 void DigitalLed::blink(int ms) { _period = ms >> 1; };
 
-GateTrigger::GateTrigger(int input_pin, int led_pin) {
+// Pin interrupts can't take an argument, so each of the first MAX_GTLS
+// inputs gets its own
+static GateTrigger* gate_inputs[MAX_GTLS];
+static int gate_input_count = 0;
+
+template <int N>
+static void gate_isr(void) {
+    gate_inputs[N]->capture();
+}
+
+static void (*const gate_isrs[])(void) = {gate_isr<0>, gate_isr<1>,
+                                          gate_isr<2>, gate_isr<3>,
+                                          gate_isr<4>, gate_isr<5>};
+static_assert(sizeof(gate_isrs) / sizeof(gate_isrs[0]) == MAX_GTLS,
+              "One interrupt per gate input");
+
+GateTrigger::GateTrigger(int input_pin, int led_pin) : _led(led_pin) {
     high = false;
     low = false;
     gate = false;
     led_override = true;
-    _state = false;
-    _last_state = false;
+    edge_us = 0;
+    _state = 1;
+    _raw = 1;
+    _interrupt = false;
+    _dropped = false;
     _input_pin = input_pin;
-    _led = new DigitalLed(led_pin);
-    _last_ms = 0;
 };
 
 void GateTrigger::setup() {
     pinMode(_input_pin, INPUT_PULLUP);
-    _led->setup();
+    _led.setup();
+    if (!_interrupt && gate_input_count < MAX_GTLS) {
+        gate_inputs[gate_input_count] = this;
+        attachInterrupt(digitalPinToInterrupt(_input_pin),
+                        gate_isrs[gate_input_count], CHANGE);
+        gate_input_count++;
+        _interrupt = true;
+    }
 }
 
-void GateTrigger::loop(unsigned long ms) {
-    int state = digitalRead(_input_pin);
-    unsigned long duration = ms - _last_ms;
-
-    if (_state == 0 && state == 1 && duration < BTN_DEBOUNCE) {
-        return;
+void GateTrigger::capture() {
+    if (!_edges.push(micros(), digitalRead(_input_pin))) {
+        _dropped = true;
     }
+}
 
-    _last_state = _state;
+void GateTrigger::take(int state, uint32_t us) {
     _state = state;
-
+    edge_us = us;
     gate = _state == 0;
-    high = _last_state == 1 && gate;
-    if (high) {
-        if (!led_override) {
-            _led->on();
+    high = gate;
+    low = !gate;
+    if (!led_override) {
+        if (gate) {
+            _led.on();
+        } else {
+            _led.off();
+        }
+    }
+}
+
+void GateTrigger::loop(unsigned long ms) {
+    uint32_t now = micros();
+    high = false;
+    low = false;
+
+    if (!_interrupt) {
+        int state = digitalRead(_input_pin);
+        if (state != _raw) {
+            _edges.push(now, state);
         }
-        _last_ms = ms;
     }
 
-    low = _last_state == 0 && _state == 1;
-    if (low) {
-        if (!led_override) {
-            _led->off();
+    bool taken = false;
+    const GateEdge* edge;
+    while (!taken && (edge = _edges.peek()) != NULL) {
+        if (edge->state != _state && edge->us - edge_us >= GATE_DEBOUNCE_US) {
+            take(edge->state, edge->us);
+            taken = true;
+        }
+        _raw = edge->state;
+        _edges.pop();
+    }
+
+    if (!taken) {
+        if (_dropped) {
+            // The queue filled up, so the last edge queued may not be the
+            // level the input ended up at
+            _dropped = false;
+            _raw = digitalRead(_input_pin);
+        }
+        // Edges held back by the debounce, once the input has settled
+        if (_raw != _state && now - edge_us >= GATE_DEBOUNCE_US) {
+            take(_raw, now);
         }
     }
 
-    _led->loop(ms);
+    _led.loop(ms);
 };
@@ -1,5 +1,10 @@
 // control.h
 
+#include <new>
+
+#include "edges.h"
+#include "scanner.h"
+
 #pragma once
 
 #ifndef M_CONTROL_H_
@@ -12,7 +17,7 @@
 #define BTN_CLICK_LONG 2000
 
 /**
- * The ControlState class holds an array of component pointers.
+ * The ControlState class holds a fixed pool of each component.
  * These values are arbitrary and can be changed to reflect the
  * actual components used by the project.
  */
@@ -20,12 +25,31 @@
 #define MAX_POTS 6
 #define MAX_DIGITAL_LEDS 6
 #define MAX_GTLS 6
+#define MAX_CVS 2
 
 #define POT_SMOOTH_SAMPLES 32
-#define POT_SMOOTH_OUTLIER_LOW (32 * 20) / 100
-#define POT_SMOOTH_OUTLIER_HIGH ((32 * 80) / 100) + 1
+#define POT_SMOOTH_OUTLIER_LOW ((POT_SMOOTH_SAMPLES * 20) / 100)
+#define POT_SMOOTH_OUTLIER_HIGH (((POT_SMOOTH_SAMPLES * 80) / 100) + 1)
 
 #define CLOCK_TIMEOUT 2000
+#define CLOCK_DEBOUNCE_US 1000
+
+/**
+ * Clock tracking. A beat further than CLOCK_OUTLIER periods from where it
+ * was predicted is an outlier, and CLOCK_RELOCK outliers in a row mean the
+ * tempo has changed. The gains set how much of each beat's timing error
+ * goes into the phase and the period.
+ */
+#define CLOCK_OUTLIER 0.2f
+#define CLOCK_RELOCK 3
+#define CLOCK_PHASE_GAIN 0.25f
+#define CLOCK_PERIOD_GAIN 0.06f
+
+// Furthest a quantized time goes from the clock, in doublings or halvings
+#define CLOCK_QUANTIZE_OCTAVES 4
+
+// Shortest time between two gate edges that are both taken
+#define GATE_DEBOUNCE_US 1000
 
 /**
  * LED abstraction with some blinking functionality.
@@ -49,18 +73,39 @@ class DigitalLed {
 };
 
 /**
- * Potentiometer class with John-Mike's smoothing method built in.
+ * Potentiometer class with John-Mike's smoothing method built in: the mean
+ * of the middle of the last POT_SMOOTH_SAMPLES readings, once the highest
+ * and lowest are dropped.
+ *
+ * The readings are also kept sorted, and each new reading replaces the one
+ * it pushes out of the window in place, like one step of an insertion sort.
+ * The sum of the middle band is updated as readings move in and out of it,
+ * so a tick costs a binary search plus however many readings lie between
+ * the old value and the new one, which is next to none for a pot at rest.
+ *
+ * Once attached to a scanner it takes the scanner's latest reading rather
+ * than waiting on analogRead().
  */
 class Potentiometer {
    public:
     int value;
     Potentiometer(int pin);
+    void attach(AnalogScanner* scanner, int channel);
     void loop(unsigned long ms);
 
    private:
+    /**
+     * Swaps one reading for another in the sorted window.
+     */
+    void replace(int old_value, int new_value);
+
     int _pin;
+    AnalogScanner* _scanner;
+    int _channel;
     int _smooth;
+    long _band_total;
     int _samples[POT_SMOOTH_SAMPLES];
+    int _sorted[POT_SMOOTH_SAMPLES];
 };
 
 /**
@@ -94,6 +139,15 @@ class Button {
 /**
  * Combination of an input pullup pin and an LED.
  *
+ * Every edge on the input is timestamped by a pin interrupt and queued, so
+ * none are missed between calls to loop(), which takes at most one edge per
+ * call. That way a trigger that's shorter than the time between calls still
+ * reports high, then low on the next call. An edge that comes within
+ * GATE_DEBOUNCE_US of the last one taken is held back until the input has
+ * settled, and the level it settled at is taken then.
+ *
+ * Inputs past the first MAX_GTLS fall back to reading the pin in loop().
+ *
  * TODO: Make a latch option, so rather than trigger, a high signal toggles
  *       the gate on or off.
  */
@@ -103,17 +157,170 @@ class GateTrigger {
     bool low;
     bool gate;
     bool led_override;
+    // When the last edge taken happened, in micros()
+    uint32_t edge_us;
 
     GateTrigger(int pin_input, int pin_led);
     void setup(void);
     void loop(unsigned long ms);
 
+    /**
+     * Queues the input's level with the time. Called by the pin interrupt.
+     */
+    void capture(void);
+
    private:
+    /**
+     * Takes a new level, setting high or low.
+     */
+    void take(int state, uint32_t us);
+
     int _input_pin;
     int _state;
-    int _last_state;
-    DigitalLed* _led;
-    unsigned long _last_ms;
+    // Level of the last edge queued, which the input settles at
+    int _raw;
+    bool _interrupt;
+    volatile bool _dropped;
+    GateEdgeQueue _edges;
+    DigitalLed _led;
+};
+
+/**
+ * Tempo tracker for a clock input.
+ *
+ * Edges are timestamped by a pin interrupt like GateTrigger's. The period
+ * and the time of the last beat are tracked like a phase-locked loop: each
+ * beat is compared with where the last one predicts it, and a share of the
+ * error goes into both. Jitter is averaged out rather than followed. A
+ * missed beat is matched to the next predicted beat after it. An extra
+ * beat, or anything else too far from a predicted beat, is ignored, unless
+ * several in a row show the tempo has changed. Then the period starts again
+ * from the median of the last few intervals.
+ *
+ * The quantize calls snap times and speeds to the clock once it's locked,
+ * and pass them through when it isn't.
+ */
+class ClockInput {
+   public:
+    // Tracked period in ms
+    float clock_interval;
+    bool is_clocked;
+    // Whether a clock edge came in the last loop()
+    bool beat;
+
+    ClockInput(int pin);
+    void setup(void);
+    void loop(unsigned long ms);
+    void reset(void);
+
+    /**
+     * Queues the input's level with the time. Called by the pin interrupt.
+     */
+    void capture(void);
+
+    /**
+     * Tracks a beat at a time in micros(). Called by loop().
+     */
+    void clock(uint32_t us);
+
+    /**
+     * @return Time of the next predicted beat after now, in micros()
+     */
+    uint32_t next_beat_us(uint32_t now);
+
+    /**
+     * @return How far now is between predicted beats, from 0 to 1
+     */
+    float phase(uint32_t now);
+
+    /**
+     * Snaps a length to the clock period times a power of two.
+     */
+    float quantize_ms(float ms);
+
+    /**
+     * Snaps a position to a grid of division steps per beat.
+     */
+    float snap_ms(float ms, int division);
+
+    /**
+     * Snaps a playback speed to a power of two, so clocked lengths stay
+     * clocked when played at it.
+     */
+    float quantize_speed(float ratio);
+
+   private:
+    int _pin;
+    int _state;
+    bool _interrupt;
+    GateEdgeQueue _edges;
+    // Beats seen since the last reset, up to 2
+    int _beats;
+    int _outliers;
+    uint32_t _last_us;
+    uint32_t _beat_us;
+    float _period_us;
+    uint32_t _intervals[CLOCK_RELOCK];
+    int _interval;
+};
+
+/**
+ * Storage for up to N components of one type, built in place rather than
+ * on the heap. Components are kept together in the order they're
+ * registered, so a scan only walks the ones that exist, and each index
+ * maps to its component's slot.
+ */
+template <class T, int N>
+class ControlPool {
+   public:
+    ControlPool(void) : _count(0) {
+        for (int i = 0; i < N; i++) {
+            _slots[i] = -1;
+        }
+    }
+
+    /**
+     * Builds the component for an index from the constructor arguments.
+     *
+     * @return The component, or NULL if the index is out of range or
+     *         already registered
+     */
+    template <class... Args>
+    T* add(int index, Args... args) {
+        if (index < 0 || index >= N || _slots[index] >= 0) {
+            return NULL;
+        }
+        _slots[index] = _count;
+        return new (_storage[_count++].bytes) T(args...);
+    }
+
+    /**
+     * @return The component registered at an index, or NULL
+     */
+    T* get(int index) {
+        if (index < 0 || index >= N || _slots[index] < 0) {
+            return NULL;
+        }
+        return &(*this)[_slots[index]];
+    }
+
+    /**
+     * Number of components registered, which are the slots from 0.
+     */
+    int count(void) { return _count; }
+
+    T& operator[](int slot) {
+        return *reinterpret_cast<T*>(_storage[slot].bytes);
+    }
+
+   private:
+    struct Slot {
+        alignas(T) uint8_t bytes[sizeof(T)];
+    };
+
+    Slot _storage[N];
+    int8_t _slots[N];
+    int _count;
 };
 
 /**
@@ -121,45 +328,49 @@ class GateTrigger {
  * and updates their state after a provided control interval. The
  * loop() method returns a boolean to indicate the interval is
  * reached and new values are read from the input pins.
+ *
+ * Pots and CV inputs are read in the background by its AnalogScanner, with
+ * CV inputs read far more often than the control rate. Call begin() once
+ * they're all registered to start it.
+ *
+ * Gate and clock inputs aren't held to the control rate. poll_gates()
+ * returns true as soon as any gate has a new edge, so call it on every pass
+ * of loop().
  */
 class ControlState {
    public:
     ControlState();
+    void begin(void);
     bool loop(void);
+    bool poll_gates(void);
     void register_button(int index, int pin);
     void register_pot(int index, int pin);
+    void register_cv(int index, int pin);
+    void register_clock(int pin);
     void register_led(int index, int pin);
     void register_gtl(int index, int input_pin, int led_pin);
     Button* get_button(int index);
     Potentiometer* get_potentiometer(int index);
+    /**
+     * @return Latest reading of a CV input, from 0 to 4095
+     */
+    int get_cv(int index);
+    AnalogScanner* get_scanner(void) { return &_scanner; }
+    ClockInput* get_clock(void) { return _clocks.get(0); }
     DigitalLed* get_led(int index);
     GateTrigger* get_gtl(int index);
 
    private:
     unsigned long _last_ms;
     unsigned long _ms;
-    Button* _buttons[MAX_BUTTONS];
-    Potentiometer* _pots[MAX_POTS];
-    DigitalLed* _leds[MAX_DIGITAL_LEDS];
-    GateTrigger* _gtls[MAX_GTLS];
-};
-
-class ClockInput {
-   public:
-    float clock_interval;
-    bool is_clocked;
-    ClockInput(int pin);
-    void setup(void);
-    void loop(void);
-    void reset(void);
-
-   private:
-    int _pin;
-    int _state;
-    int _last_state;
-    unsigned long _last_ms;
-    int _duration_total;
-    int _durations;
+    ControlPool<Button, MAX_BUTTONS> _buttons;
+    ControlPool<Potentiometer, MAX_POTS> _pots;
+    ControlPool<DigitalLed, MAX_DIGITAL_LEDS> _leds;
+    ControlPool<GateTrigger, MAX_GTLS> _gtls;
+    ControlPool<ClockInput, 1> _clocks;
+    // Scanner channel of each CV input, or -1
+    int _cvs[MAX_CVS];
+    AnalogScanner _scanner;
 };
 
 #endif
@@ -0,0 +1,86 @@
+// crossing.h
+
+#include <Arduino.h>
+
+#pragma once
+
+#ifndef M_CROSSING_H_
+#define M_CROSSING_H_
+
+/**
+ * Zero-crossing scanners for whole blocks of samples, for finding where to
+ * start recording or where to snap the ends of a grain.
+ *
+ * A crossing is any change of sign bit between neighbouring samples, so 0
+ * counts as positive. The scanners load two samples per 32-bit word and test
+ * four samples at a time by comparing only their sign bits against the sign
+ * they're looking for a change from, so the common case of a run with no
+ * crossing costs two loads, two XORs and one branch per four samples. The
+ * exact sample is only searched for one at a time in the last word. Loads go
+ * through memcpy, so the data needn't be word aligned.
+ */
+
+// Sign bits of both samples in a word
+#define GRAIN_SIGN_BITS 0x80008000u
+
+/**
+ * Finds the first sign change in a block.
+ *
+ * @param data Samples to scan
+ * @param n Number of samples
+ * @param prev The sample just before data[0]
+ * @return Index of the first sample whose sign differs from the sample
+ *         before it, or n if there's no crossing
+ */
+static inline int grain_zero_crossing(const int16_t *data, int n,
+                                      int16_t prev) {
+    uint32_t same = prev < 0 ? GRAIN_SIGN_BITS : 0;
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint32_t a, b;
+        memcpy(&a, data + i, sizeof(a));
+        memcpy(&b, data + i + 2, sizeof(b));
+        if (((a ^ same) | (b ^ same)) & GRAIN_SIGN_BITS) {
+            break;
+        }
+    }
+    // Every sample before i has the same sign as prev
+    for (; i < n; i++) {
+        if ((data[i] ^ prev) < 0) {
+            return i;
+        }
+    }
+    return n;
+}
+
+/**
+ * Finds the last sign change in a block, scanning backwards.
+ *
+ * @param data Samples to scan
+ * @param n Number of samples
+ * @param next The sample just after data[n - 1]
+ * @return Index of the last sample whose sign differs from the sample before
+ *         it, counting next as index n, or 0 if there's no crossing
+ */
+static inline int grain_zero_crossing_back(const int16_t *data, int n,
+                                           int16_t next) {
+    uint32_t same = next < 0 ? GRAIN_SIGN_BITS : 0;
+    int i = n;
+    for (; i >= 4; i -= 4) {
+        uint32_t a, b;
+        memcpy(&a, data + i - 4, sizeof(a));
+        memcpy(&b, data + i - 2, sizeof(b));
+        if (((a ^ same) | (b ^ same)) & GRAIN_SIGN_BITS) {
+            break;
+        }
+    }
+    // Every sample from i on has the same sign as next
+    for (; i > 0; i--) {
+        if ((data[i - 1] ^ next) < 0) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,71 @@
+// edges.h
+
+#include <Arduino.h>
+
+#pragma once
+
+#ifndef M_EDGES_H_
+#define M_EDGES_H_
+
+/**
+ * Number of edges that can be waiting at once. A power of two.
+ */
+#define GATE_EDGE_QUEUE 16
+
+/**
+ * A change of level on a gate input, as read by its pin interrupt.
+ */
+struct GateEdge {
+    uint32_t us;
+    uint8_t state;
+};
+
+/**
+ * Bounded single-producer, single-consumer queue of edges, posted from a pin
+ * interrupt and taken by loop(). An edge that doesn't fit is dropped, and
+ * the next one to fit still carries the pin's level.
+ */
+class GateEdgeQueue {
+   public:
+    GateEdgeQueue(void) : head(0), tail(0) {}
+
+    /**
+     * @return Whether there was room for the edge
+     */
+    bool push(uint32_t us, uint8_t state) {
+        uint32_t at = head;
+        if (at - tail >= GATE_EDGE_QUEUE) {
+            return false;
+        }
+        GateEdge &edge = edges[at & (GATE_EDGE_QUEUE - 1)];
+        edge.us = us;
+        edge.state = state;
+        __sync_synchronize();
+        head = at + 1;
+        return true;
+    }
+
+    /**
+     * @return The oldest edge, or NULL if there are none
+     */
+    const GateEdge *peek(void) {
+        uint32_t at = tail;
+        if (at == head) {
+            return NULL;
+        }
+        __sync_synchronize();
+        return &edges[at & (GATE_EDGE_QUEUE - 1)];
+    }
+
+    void pop(void) {
+        __sync_synchronize();
+        tail = tail + 1;
+    }
+
+   private:
+    GateEdge edges[GATE_EDGE_QUEUE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+};
+
+#endif
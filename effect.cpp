@@ -2,44 +2,87 @@
 
 #include <Arduino.h>
 
-void GrainScrubEffect::begin(int16_t *sample_bank_def, int16_t max_len_def) {
-    max_sample_len = max_len_def;
-    length_ms = ((float)max_sample_len / AUDIO_SAMPLE_RATE_EXACT) * 1000;
-    read_head = 0;
+void GrainScrubEffect::begin(int16_t *sample_bank_def, int32_t max_len_def) {
+    bank_len = max_len_def;
+    ring.begin(sample_bank_def, max_len_def);
+    base = 0;
+    preroll = false;
+    beginPlayer(max_len_def);
     write_head = 0;
     prev_input = 0;
-    playback_rate = 65536;
-    next_playback_rate = 65536;
-    accumulator = 0;
-    reversed = false;
-    next_reversed = false;
     sample_loaded = false;
+    write_enabled = false;
+    zero_found = false;
+    running = false;
+    request = 0;
+    started = 0;
     sample_bank = sample_bank_def;
 }
 
 void GrainScrubEffect::start() {
-    if (running) {
-      return;
+    uint32_t current = request;
+    if (current & 1) {
+        return;
     }
-    __disable_irq();
-    sample_loaded = false;
-    write_enabled = false;
-    zero_found = false;
-    running = true;
-    offset = next_offset;
-    length = next_length;
-    playback_rate = next_playback_rate;
-    reversed = next_reversed;
-    __enable_irq();
+    request = (current + 2) | 1;
 }
 
-void GrainScrubEffect::stop() {
-    __disable_irq();
-    running = false;
-    zero_found = false;
-    sample_loaded = false;
-    write_enabled = false;
-    __enable_irq();
+void GrainScrubEffect::stop() { request = request & ~1; }
+
+void GrainScrubEffect::sync(void) {
+    uint32_t current = request;
+    if ((current >> 1) != started) {
+        started = current >> 1;
+        sample_loaded = false;
+        write_enabled = false;
+        zero_found = false;
+        accumulator = 0;
+        position = 0;
+        latch();
+        if (preroll) {
+            capture();
+        }
+    }
+    running = current & 1;
+}
+
+void GrainScrubEffect::capture(void) {
+    const int16_t *bank = ring.bank;
+    int32_t mask = ring.mask;
+    int32_t oldest = ring.write_head;
+
+    // Latest start, relative to the oldest sample, that lets the whole grain
+    // play from audio recorded before the trigger
+    int32_t from = max_sample_len - (offset + length);
+    if (from < 1) {
+        from = 1;
+    }
+    int32_t at = from;
+    int32_t k = from;
+    int16_t next = bank[(oldest + k) & mask];
+    // Scan back from the start in runs that don't wrap around the ring
+    while (k > 0) {
+        int32_t stop = (oldest + k) & mask;
+        if (stop == 0) {
+            stop = ring.size;
+        }
+        int32_t n = min(k, stop);
+        int found = grain_zero_crossing_back(bank + stop - n, n, next);
+        if (found > 0) {
+            at = k - n + found;
+            break;
+        }
+        k -= n;
+        next = bank[stop - n];
+    }
+
+    base = (oldest + at) & mask;
+    // Keep recording over the audio before the zero crossing until the
+    // buffer is full
+    write_head = max_sample_len - at;
+    write_enabled = write_head < max_sample_len;
+    zero_found = true;
+    sample_loaded = true;
 }
 
 void GrainScrubEffect::update(void) {
@@ -58,92 +101,103 @@ void GrainScrubEffect::update(void) {
         return;
     }
 
+    sync();
     if (!running) {
         prev_input = block->data[AUDIO_BLOCK_SAMPLES - 1];
-    } else {
-        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
-            // Step 1: Find zero-crossing
-            if (!zero_found) {
-                int16_t current_input = block->data[i];
-                if ((current_input < 0 && prev_input >= 0) ||
-                    (current_input >= 0 && prev_input < 0)) {
-                    write_enabled = true;
-                    write_head = 0;
-                    read_head = 0;
-                    zero_found = true;
-                } else {
-                    prev_input = current_input;
-                }
+        if (preroll) {
+            ring.record(block->data, AUDIO_BLOCK_SAMPLES);
+        }
+    } else if (preroll) {
+        if (write_enabled) {
+            int count = min(AUDIO_BLOCK_SAMPLES, max_sample_len - write_head);
+            ring.record(block->data, count);
+            write_head += count;
+            if (write_head >= max_sample_len) {
+                write_enabled = false;
             }
+        }
+        play(block->data, AUDIO_BLOCK_SAMPLES);
+    } else {
+        int i = 0;
 
-            // Step 2: Write samples to buffer
-            if (write_enabled) {
-                sample_bank[write_head++] = block->data[i];
-                if (write_head >= offset + length) {
-                    sample_loaded = true;
-                }
-                if (write_head >= max_sample_len) {
-                    write_enabled = false;
-                }
+        // Step 1: Find zero-crossing
+        if (!zero_found) {
+            i = grain_zero_crossing(block->data, AUDIO_BLOCK_SAMPLES,
+                                    prev_input);
+            if (i < AUDIO_BLOCK_SAMPLES) {
+                write_enabled = true;
+                write_head = 0;
+                read_head = 0;
+                zero_found = true;
+            } else {
+                prev_input = block->data[AUDIO_BLOCK_SAMPLES - 1];
             }
+        }
 
-            // Step 3: Figure playback
-            if (sample_loaded) {
-                if (!reversed) {
-                    accumulator += playback_rate;
-                    read_head = accumulator >> 16;
-                    if (read_head >= length || read_head < 0) {
-                        accumulator = 0;
-                        read_head = 0;
-                        // Only change the offset/length after a full repeat
-                        offset = next_offset;
-                        length = next_length;
-                        playback_rate = next_playback_rate;
-                        reversed = next_reversed;
-                    }
-                    // NOTE: Keep an ear out for pops if the length/start
-                    // changes during a fade out.
-                    if (length - read_head < 20) {
-                        float fade_out = sample_bank[offset + read_head] *
-                                         ((float)(length - read_head) / 20.0);
-                        block->data[i] = (int16_t)fade_out;
-                    } else if (read_head < 20) {
-                        float fade_out = sample_bank[offset + read_head] *
-                                         ((float)read_head / 20.0);
-                        block->data[i] = (int16_t)fade_out;
-                    } else {
-                        block->data[i] = sample_bank[offset + read_head];
-                    }
-                } else {  // Reverse grains
-                    accumulator += playback_rate;
-                    read_head = length - (accumulator >> 16) - 1;
-                    if (read_head < 0 || read_head >= length) {
-                        accumulator = 0;
-                        read_head = length - 1;
-                        // Only change the offset/length after a full repeat
-                        offset = next_offset;
-                        length = next_length;
-                        playback_rate = next_playback_rate;
-                        reversed = next_reversed;
-                    }
-                    // NOTE: Keep an ear out for pops if the length/start
-                    // changes during a fade out.
-                    if (length - read_head < 20) {
-                        float fade_out = sample_bank[offset + read_head] *
-                                         ((float)read_head / 20.0);
-                        block->data[i] = (int16_t)fade_out;
-                    } else if (read_head < 20) {
-                        float fade_out = sample_bank[offset + read_head] *
-                                         ((float)read_head / 20.0);
-                        block->data[i] = (int16_t)fade_out;
-                    } else {
-                        block->data[i] = sample_bank[offset + read_head];
-                    }
-                }
+        // Step 2: Write samples to buffer, noting the sample at which the
+        // whole grain has been loaded
+        int play_from = sample_loaded ? 0 : AUDIO_BLOCK_SAMPLES;
+        if (write_enabled) {
+            int count = min(AUDIO_BLOCK_SAMPLES - i, max_sample_len - write_head);
+            memcpy(sample_bank + write_head, block->data + i,
+                   count * sizeof(int16_t));
+            if (!sample_loaded && write_head + count >= offset + length) {
+                sample_loaded = true;
+                play_from = i + max(offset + length - write_head - 1, 0);
+            }
+            write_head += count;
+            if (write_head >= max_sample_len) {
+                write_enabled = false;
             }
         }
+
+        // Step 3: Figure playback
+        if (sample_loaded) {
+            play(block->data + play_from, AUDIO_BLOCK_SAMPLES - play_from);
+        }
     }
 
     transmit(block);
     release(block);
 }
+
+void GrainScrubEffect::play(int16_t *out, int n) {
+    GrainParams grain = params();
+    int i = 0;
+    while (i < n) {
+        if (grain_finished(grain, accumulator, position)) {
+            accumulator = 0;
+            position = 0;
+            // Only change the offset/length after a full repeat
+            latch();
+            grain = params();
+        }
+        if (length <= 0) {
+            memset(out + i, 0, (n - i) * sizeof(int16_t));
+            break;
+        }
+        if (preroll) {
+            i += grain_play_span<true>(out + i, n - i, grain, accumulator,
+                                       position);
+        } else {
+            i += grain_play_span<false>(out + i, n - i, grain, accumulator,
+                                        position);
+        }
+    }
+    read_head = position + (accumulator >> 16);
+}
+
+void GrainScrubEffect::latch(void) {
+    // Keeps the last settings if the control loop is mid-publish
+    settings.read(latched);
+    offset = latched.offset;
+    length = latched.length;
+    latchPlayback();
+}
+
+GrainParams GrainScrubEffect::params(void) {
+    if (preroll) {
+        return grainParams(ring.bank, ring.mask, base + offset);
+    }
+    return grainParams(sample_bank, max_sample_len - 1, offset);
+}
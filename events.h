@@ -0,0 +1,84 @@
+// events.h
+
+#include <Arduino.h>
+
+#pragma once
+
+#ifndef M_EVENTS_H_
+#define M_EVENTS_H_
+
+/**
+ * Number of events that can be waiting at once. A power of two.
+ */
+#define GRAIN_EVENT_QUEUE 32
+
+enum GrainEventType {
+    GRAIN_EVENT_START,
+    GRAIN_EVENT_STOP,
+    GRAIN_EVENT_OFFSET,
+    GRAIN_EVENT_LENGTH,
+    GRAIN_EVENT_SPEED,
+    GRAIN_EVENT_DIRECTION
+};
+
+/**
+ * A change to one read head, due at a sample time counted by the node
+ * that plays it.
+ */
+struct GrainEvent {
+    uint32_t time;
+    // Offset, length or 16.16 rate in samples, or 1 for reverse
+    int32_t value;
+    // Length that goes with a new offset
+    int32_t length;
+    uint8_t type;
+    uint8_t target;
+};
+
+/**
+ * Bounded single-producer, single-consumer queue of events, posted from
+ * loop() and taken by the audio interrupt. Events are taken in the order
+ * they were posted, so they should be posted in time order.
+ */
+class GrainEventQueue {
+   public:
+    GrainEventQueue(void) : head(0), tail(0) {}
+
+    /**
+     * @return Whether there was room for the event
+     */
+    bool push(const GrainEvent &event) {
+        uint32_t at = head;
+        if (at - tail >= GRAIN_EVENT_QUEUE) {
+            return false;
+        }
+        events[at & (GRAIN_EVENT_QUEUE - 1)] = event;
+        __sync_synchronize();
+        head = at + 1;
+        return true;
+    }
+
+    /**
+     * @return The oldest event, or NULL if there are none
+     */
+    const GrainEvent *peek(void) {
+        uint32_t at = tail;
+        if (at == head) {
+            return NULL;
+        }
+        __sync_synchronize();
+        return &events[at & (GRAIN_EVENT_QUEUE - 1)];
+    }
+
+    void pop(void) {
+        __sync_synchronize();
+        tail = tail + 1;
+    }
+
+   private:
+    GrainEvent events[GRAIN_EVENT_QUEUE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+};
+
+#endif
@@ -0,0 +1,247 @@
+// grain.h
+
+#include <Arduino.h>
+
+#include "interp.h"
+#include "window.h"
+
+#pragma once
+
+#ifndef M_GRAIN_H_
+#define M_GRAIN_H_
+
+/**
+ * Default number of samples faded in and out at each end of a grain.
+ */
+#define GRAIN_FADE_SAMPLES 20
+
+/**
+ * Regions of a grain, in playback order. Each region gets its own kernel so
+ * the steady-state body of a grain is a plain copy loop.
+ */
+enum GrainRegion { GRAIN_FADE_IN, GRAIN_BODY, GRAIN_FADE_OUT };
+
+/**
+ * Everything the kernels need to play one grain. The effects rebuild this
+ * whenever they latch a new grain.
+ */
+struct GrainParams {
+    // Sample buffer to read from
+    const int16_t *bank;
+    // Ring mask when the buffer wraps, otherwise the last valid index
+    int32_t mask;
+    // Index of the first sample of the grain and its length in samples
+    int32_t start;
+    int32_t length;
+    // 16.16 fixed-point playback rate
+    int32_t rate;
+    // Length of the fade at each end, at most half of length
+    int32_t fade;
+    // Q15 window table from grain_window() and its grain_window_step()
+    const int16_t *window;
+    uint32_t window_step;
+    // Window position of the first sample, only set while fading in
+    uint32_t window_phase;
+    bool reversed;
+    GrainInterpolation interpolation;
+};
+
+/**
+ * Settings for the next grain. The setters publish them from the control
+ * loop, and the audio interrupt latches them each time a grain repeats.
+ */
+struct GrainSettings {
+    int32_t offset;
+    int32_t length;
+    // 16.16 fixed-point playback rate
+    int32_t rate;
+    int32_t fade;
+    const int16_t *window;
+    bool reversed;
+    GrainInterpolation interpolation;
+};
+
+/**
+ * Resolves a buffer index, wrapping it around the ring or clamping it to the
+ * ends of a one-shot buffer. Only the neighbours used for interpolation can
+ * fall outside the buffer.
+ */
+template <bool Wrap>
+static inline int32_t grain_index(const GrainParams &g, int32_t index) {
+    if (Wrap) {
+        return index & g.mask;
+    }
+    return index < 0 ? 0 : (index > g.mask ? g.mask : index);
+}
+
+/**
+ * Reads the sample under a 16.16 fixed-point playback position. A reversed
+ * grain steps towards lower indices, so its neighbours are mirrored.
+ */
+template <bool Reversed, bool Wrap, int Interp>
+static inline int32_t grain_read(const GrainParams &g, uint32_t accumulator) {
+    const int32_t step = Reversed ? -1 : 1;
+    int32_t t = accumulator >> 16;
+    int32_t index = Reversed ? g.start + g.length - 1 - t : g.start + t;
+    if (Interp == GRAIN_INTERP_LINEAR) {
+        return grain_interpolate_linear(
+            g.bank[grain_index<Wrap>(g, index)],
+            g.bank[grain_index<Wrap>(g, index + step)], accumulator);
+    } else if (Interp == GRAIN_INTERP_HERMITE) {
+        return grain_interpolate_hermite(
+            g.bank[grain_index<Wrap>(g, index - step)],
+            g.bank[grain_index<Wrap>(g, index)],
+            g.bank[grain_index<Wrap>(g, index + step)],
+            g.bank[grain_index<Wrap>(g, index + 2 * step)], accumulator);
+    }
+    if (Wrap) {
+        index &= g.mask;
+    }
+    return g.bank[index];
+}
+
+/**
+ * Plays n samples of a single region of a grain. Everything that would
+ * otherwise be tested per sample (direction, region, interpolation and
+ * whether the buffer is a ring) is a template parameter, so each combination
+ * compiles to its own branch-free loop.
+ *
+ * The grain envelope follows playback time, so a reversed grain fades in at
+ * the end of its slice of the buffer and fades out at the start.
+ *
+ * @param out Output samples
+ * @param n Number of samples to play
+ * @param g Grain being played
+ * @param accumulator 16.16 fixed-point playback position within the grain
+ * @return The accumulator after the last sample played
+ */
+template <bool Reversed, int Region, bool Wrap, int Interp>
+static inline uint32_t grain_kernel(int16_t *out, int n, const GrainParams &g,
+                                    uint32_t accumulator) {
+    const int32_t rate = g.rate;
+    for (int i = 0; i < n; i++) {
+        int32_t t = accumulator >> 16;
+        int32_t sample = grain_read<Reversed, Wrap, Interp>(g, accumulator);
+        if (Region == GRAIN_FADE_IN) {
+            int32_t gain = g.window[(t * g.window_step + g.window_phase) >> 16];
+            out[i] = (sample * gain) >> 15;
+        } else if (Region == GRAIN_FADE_OUT) {
+            int32_t gain = g.window[((g.length - t) * g.window_step) >> 16];
+            out[i] = (sample * gain) >> 15;
+        } else {
+            out[i] = sample;
+        }
+        accumulator += rate;
+    }
+    return accumulator;
+}
+
+template <bool Reversed, bool Wrap, int Interp>
+static inline uint32_t grain_play_region(int region, int16_t *out, int n,
+                                         const GrainParams &g,
+                                         uint32_t accumulator) {
+    switch (region) {
+        case GRAIN_FADE_IN:
+            return grain_kernel<Reversed, GRAIN_FADE_IN, Wrap, Interp>(
+                out, n, g, accumulator);
+        case GRAIN_BODY:
+            return grain_kernel<Reversed, GRAIN_BODY, Wrap, Interp>(
+                out, n, g, accumulator);
+        default:
+            return grain_kernel<Reversed, GRAIN_FADE_OUT, Wrap, Interp>(
+                out, n, g, accumulator);
+    }
+}
+
+template <bool Wrap, int Interp>
+static inline uint32_t grain_play_direction(int region, int16_t *out, int n,
+                                            const GrainParams &g,
+                                            uint32_t accumulator) {
+    if (g.reversed) {
+        return grain_play_region<true, Wrap, Interp>(region, out, n, g,
+                                                     accumulator);
+    }
+    return grain_play_region<false, Wrap, Interp>(region, out, n, g,
+                                                  accumulator);
+}
+
+/**
+ * Plays from the current position up to the end of the current grain region
+ * or the end of the output, whichever comes first. The region, direction and
+ * interpolation are chosen once for the whole span.
+ *
+ * The accumulator only holds the position since the start of the span, and
+ * whole samples are folded into base before each span. The kernels see the
+ * rest of the grain as if it started at base, so a grain can be any length
+ * that fits in 32 bits at the same per-sample cost.
+ *
+ * @param base Samples of the grain played before the accumulator
+ * @return Number of samples played
+ */
+template <bool Wrap>
+static inline int grain_play_span(int16_t *out, int n, const GrainParams &g,
+                                  uint32_t &accumulator, int32_t &base) {
+    base += accumulator >> 16;
+    accumulator &= 0xFFFF;
+
+    int32_t fade_out_start = g.length - g.fade;
+    GrainParams view = g;
+    view.length = g.length - base;
+    if (!g.reversed) {
+        view.start = g.start + base;
+    }
+    view.window_phase = 0;
+
+    int region;
+    int32_t end;
+    if (base >= fade_out_start) {
+        region = GRAIN_FADE_OUT;
+        end = g.length;
+    } else if (base < g.fade) {
+        region = GRAIN_FADE_IN;
+        end = g.fade;
+        view.window_phase = base * g.window_step;
+    } else {
+        region = GRAIN_BODY;
+        end = fade_out_start;
+    }
+
+    // One divide per span rather than a compare per sample. A block never
+    // spans more than a few hundred samples, so the distance to the end of a
+    // long region is capped to keep it in 16.16.
+    int32_t ahead = end - base;
+    if (ahead > 0x7FFF) {
+        ahead = 0x7FFF;
+    }
+    uint32_t remaining = ((uint32_t)ahead << 16) - accumulator;
+    uint32_t span = (remaining + g.rate - 1) / g.rate;
+    if (span < (uint32_t)n) {
+        n = span;
+    }
+
+    switch (g.interpolation) {
+        case GRAIN_INTERP_LINEAR:
+            accumulator = grain_play_direction<Wrap, GRAIN_INTERP_LINEAR>(
+                region, out, n, view, accumulator);
+            break;
+        case GRAIN_INTERP_HERMITE:
+            accumulator = grain_play_direction<Wrap, GRAIN_INTERP_HERMITE>(
+                region, out, n, view, accumulator);
+            break;
+        default:
+            accumulator = grain_play_direction<Wrap, GRAIN_INTERP_NONE>(
+                region, out, n, view, accumulator);
+            break;
+    }
+    return n;
+}
+
+/**
+ * Whether a grain played with grain_play_span() has reached its end.
+ */
+static inline bool grain_finished(const GrainParams &g, uint32_t accumulator,
+                                  int32_t base) {
+    return base + (int32_t)(accumulator >> 16) >= g.length;
+}
+
+#endif
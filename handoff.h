@@ -0,0 +1,78 @@
+// handoff.h
+
+#include <Arduino.h>
+
+#pragma once
+
+#ifndef M_HANDOFF_H_
+#define M_HANDOFF_H_
+
+/**
+ * Number of times read() retries a value caught mid-publish before giving
+ * up. On a single core a writer interrupted by the reader can't finish, so
+ * this only matters where they truly run in parallel.
+ */
+#define GRAIN_HANDOFF_TRIES 4
+
+/**
+ * A seqlock that hands a block of parameters from one context to another
+ * without masking interrupts. One side publishes whole copies of the value.
+ * The other reads the latest complete copy, never half of one update and
+ * half of the next.
+ *
+ * The sequence is odd while a publish is under way. A reader that sees it
+ * odd, or sees it change while copying, has caught the writer mid-publish.
+ * When that reader is the audio interrupt, the writer can't finish until
+ * the interrupt returns. So read() gives up rather than spin, and the
+ * caller keeps the values it already has until its next attempt.
+ *
+ * There must only be one writer, and publish() must never be interrupted by
+ * another publish() to the same handoff.
+ */
+template <typename T>
+class GrainHandoff {
+   public:
+    GrainHandoff(void) : sequence(0) {}
+
+    void publish(const T &next) {
+        sequence = sequence + 1;
+        __sync_synchronize();
+        value = next;
+        __sync_synchronize();
+        sequence = sequence + 1;
+    }
+
+    /**
+     * @param seen If given, the copy last read through it. Nothing is read
+     *             unless something newer has been published since.
+     * @return Whether out was filled with a complete copy
+     */
+    bool read(T &out, uint32_t *seen = NULL) const {
+        for (int i = 0; i < GRAIN_HANDOFF_TRIES; i++) {
+            uint32_t before = sequence;
+            __sync_synchronize();
+            if (seen != NULL && before == *seen) {
+                return false;
+            }
+            if (before & 1) {
+                continue;
+            }
+            T copy = value;
+            __sync_synchronize();
+            if (sequence == before) {
+                out = copy;
+                if (seen != NULL) {
+                    *seen = before;
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+   private:
+    volatile uint32_t sequence;
+    T value;
+};
+
+#endif
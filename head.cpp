@@ -0,0 +1,378 @@
+#include "head.h"
+
+#include <Arduino.h>
+
+// Interpolation reads up to two samples either side of the read head
+#define TAPS 2
+
+// Octaves a modulated length is quantized within either side of the beat,
+// the same as ClockInput::quantize_ms()
+#define BEAT_OCTAVES 4
+
+void GrainHead::begin(GrainRing *ring_def, GrainCache *cache_def) {
+    ring = ring_def;
+    cache = ring->bank == NULL ? cache_def : NULL;
+    recorded = 0;
+    guard = 0;
+    bias = 0;
+    running = false;
+    request = 0;
+    synced = 0;
+    settings_seen = 0;
+    beginPlayer(ring->size);
+    next_modulation.target = GRAIN_MOD_NONE;
+    next_modulation.quantum = 0;
+    modulation = next_modulation;
+    modulation_seen = 0;
+    modulation_value = 0;
+    modulations.publish(next_modulation);
+    // Nothing left over from before for prefetch() to take as playing
+    Playback idle;
+    memset(&idle, 0, sizeof(idle));
+    playback.publish(idle);
+}
+
+void GrainHead::start() {
+    // Already started, and either still waiting for the audio interrupt or
+    // playing. Decided from the request word, as running lags behind it by
+    // up to a block, so a stop() and start() within one block still
+    // restart. A head stopped by an event is started again.
+    uint32_t current = request;
+    if ((current & 1) && (current != synced || running)) {
+        return;
+    }
+    if (cache != NULL) {
+        // The writer has moved on since anything was fetched
+        cache->invalidate();
+    }
+    // The oldest sample in the ring becomes the start of the frozen buffer
+    freeze_from = ring->write_head;
+    __sync_synchronize();
+    request = (((current >> 1) + 1) << 1) | 1;
+    // Fetch the start of the grain now so the first block doesn't miss
+    prefetch();
+}
+
+void GrainHead::stop() { request = ((request >> 1) + 1) << 1; }
+
+void GrainHead::sync(void) {
+    uint32_t current = request;
+    if (current == synced) {
+        return;
+    }
+    synced = current;
+    if (current & 1) {
+        freeze(freeze_from);
+        running = true;
+    } else {
+        running = false;
+    }
+}
+
+bool GrainHead::post(uint32_t time, GrainEventType type, int32_t value) {
+    if (events == NULL) {
+        return false;
+    }
+    GrainEvent event;
+    event.time = time;
+    event.value = value;
+    event.length = next.length;
+    event.type = type;
+    event.target = index;
+    return events->push(event);
+}
+
+void GrainHead::publishModulation(GrainModTarget target, int32_t quantum) {
+    if (next_modulation.target == target &&
+        next_modulation.quantum == quantum) {
+        return;
+    }
+    next_modulation.target = target;
+    next_modulation.quantum = quantum;
+    modulations.publish(next_modulation);
+}
+
+void GrainHead::modulate(int32_t value) {
+    modulations.read(modulation, &modulation_seen);
+    modulation_value = value < 0 ? 0 : value;
+}
+
+void GrainHead::modulated(const GrainModulation &mod, int32_t value,
+                          int32_t &start, int32_t &len) const {
+    int32_t at = ((int64_t)value * max_sample_len) >> 15;
+    int32_t quantum = mod.quantum;
+    switch (mod.target) {
+        case GRAIN_MOD_START:
+            // As setStartPos(), which leaves the ideal length alone
+            if (quantum > 0) {
+                at = (at + quantum / 2) / quantum * quantum;
+            }
+            if (at > max_sample_len * 99 / 100) {
+                at = max_sample_len * 99 / 100;
+            }
+            start = at;
+            break;
+        case GRAIN_MOD_LENGTH:
+            // As setLengthPos(), or setLengthMs() with the length snapped
+            // to the nearest power of two times the beat
+            if (at < max_sample_len / 100) {
+                at = max_sample_len / 100;
+            }
+            if (quantum > 0) {
+                int64_t squared = (int64_t)at * at;
+                int64_t end = quantum;
+                for (int k = 0; k < BEAT_OCTAVES && squared >= 2 * end * end;
+                     k++) {
+                    end <<= 1;
+                }
+                for (int k = 0; k < BEAT_OCTAVES && 2 * squared < end * end;
+                     k++) {
+                    end >>= 1;
+                }
+                at = end < max_sample_len ? end : max_sample_len;
+            }
+            len = at - start;
+            if (len < 50) {
+                len = max_sample_len - start - 1;
+            }
+            break;
+    }
+}
+
+int32_t GrainHead::modulatedRate(const GrainModulation &mod,
+                                 int32_t value) const {
+    if (mod.quantum != 0) {
+        int octaves = (value * 6 + 16383) / 32767 - 3;
+        return speedRate(ldexpf(1.0, octaves));
+    }
+    return speedRate(exp2f(value * (6.0f / 32767) - 3.0f));
+}
+
+void GrainHead::apply(const GrainEvent &event, int32_t from) {
+    switch (event.type) {
+        case GRAIN_EVENT_START:
+            if (cache != NULL) {
+                cache->invalidate();
+            }
+            freeze(from);
+            running = true;
+            break;
+        case GRAIN_EVENT_STOP:
+            running = false;
+            break;
+        case GRAIN_EVENT_OFFSET:
+            latched.offset = event.value;
+            latched.length = event.length;
+            break;
+        case GRAIN_EVENT_LENGTH:
+            latched.length = event.value;
+            break;
+        case GRAIN_EVENT_SPEED:
+            latched.rate = event.value;
+            playback_rate = event.value;
+            break;
+        case GRAIN_EVENT_DIRECTION:
+            latched.reversed = event.value;
+            break;
+    }
+}
+
+void GrainHead::freeze(int32_t from) {
+    read_head = 0;
+    accumulator = 0;
+    position = 0;
+    read_head_offset = from;
+    // Anything the writer has recorded since start() was called
+    recorded = (ring->write_head - from) & ring->mask;
+    guard = max_sample_len;
+    latch();
+    guard = offset;
+    bias = 0;
+}
+
+void GrainHead::play(int16_t *out, int n) {
+    GrainParams grain = params();
+    int i = 0;
+    while (i < n) {
+        if (grain_finished(grain, accumulator, position)) {
+            accumulator = 0;
+            position = 0;
+            // Only change the offset/length after a full repeat
+            int32_t start = offset + read_head_offset;
+            int32_t len = length;
+            bool rev = reversed;
+            latch();
+            if (cache != NULL) {
+                bias = follow(start, len, rev, bias,
+                              offset + read_head_offset, length, reversed);
+            }
+            grain = params();
+        }
+        if (length <= 0) {
+            memset(out + i, 0, (n - i) * sizeof(int16_t));
+            break;
+        }
+        if (cache != NULL && !cached(grain, n - i)) {
+            // Hold the read head until prefetch() catches up
+            memset(out + i, 0, (n - i) * sizeof(int16_t));
+            cache->misses++;
+            break;
+        } else if (grain.bank == NULL) {
+            memset(out + i, 0, (n - i) * sizeof(int16_t));
+            break;
+        }
+        i += grain_play_span<true>(out + i, n - i, grain, accumulator,
+                                   position);
+    }
+    read_head = position + (accumulator >> 16);
+
+    Playback now;
+    now.synced = synced;
+    now.start = offset + read_head_offset;
+    now.length = length;
+    now.position = read_head;
+    now.recorded = recorded;
+    now.read_head_offset = read_head_offset;
+    now.bias = bias;
+    now.reversed = reversed;
+    playback.publish(now);
+}
+
+void GrainHead::latch(void) {
+    // Only replaced when the control loop has published since, and not
+    // while it's mid-publish, so due events aren't overwritten
+    settings.read(latched, &settings_seen);
+    offset = latched.offset;
+    length = latched.length;
+    modulated(modulation, modulation_value, offset, length);
+    frozen(offset, length, recorded);
+    if (offset < guard) {
+        guard = offset;
+    }
+    latchPlayback();
+    if (modulation.target == GRAIN_MOD_SPEED) {
+        playback_rate = modulatedRate(modulation, modulation_value);
+    }
+}
+
+void GrainHead::frozen(int32_t &start, int32_t &len, int32_t since) {
+    // Audio recorded since the freeze sits at the start of the ring, and
+    // the end of the ring wraps round to it, so grains and their
+    // interpolation taps have to stay between the two
+    int32_t first = since > 0 ? since + TAPS : 0;
+    if (start < first) {
+        start = first;
+    }
+    if (start + len > max_sample_len - TAPS) {
+        len = max_sample_len - TAPS - start;
+    }
+}
+
+GrainParams GrainHead::params(void) {
+    int32_t start = offset + read_head_offset;
+    if (cache != NULL) {
+        return grainParams(cache->data, GRAIN_CACHE_SAMPLES - 1,
+                           start + (bias << GRAIN_PAGE_BITS));
+    }
+    return grainParams(ring->bank, ring->mask, start);
+}
+
+bool GrainHead::cached(const GrainParams &grain, int n) {
+    int32_t t0 = position + (accumulator >> 16);
+    // Later spans check again after the grain repeats
+    int32_t t1 = t0 + (((uint32_t)n * grain.rate) >> 16) + 1;
+    if (t1 > grain.length) {
+        t1 = grain.length;
+    }
+    int32_t start = grain.start - (bias << GRAIN_PAGE_BITS);
+    if (grain.reversed) {
+        int32_t end = start + grain.length;
+        return cache->resident(end - t1 - TAPS, end - 1 - t0 + TAPS, bias);
+    }
+    return cache->resident(start + t0 - TAPS, start + t1 + TAPS, bias);
+}
+
+void GrainHead::prefetch(void) {
+    uint32_t current = request;
+    if (cache == NULL || !(current & 1)) {
+        return;
+    }
+
+    Playback now;
+    if (!playback.read(now)) {
+        return;
+    }
+    bool first = now.synced != current;
+    if (first) {
+        // The audio interrupt hasn't frozen the ring yet, so only the start
+        // of the first grain is known
+        now.length = 0;
+        now.position = 0;
+        now.read_head_offset = freeze_from;
+        now.recorded = (ring->write_head - freeze_from) & ring->mask;
+    }
+
+    // Same as latch() will do, as a reversed grain starts from its end
+    int32_t next_start = next.offset;
+    int32_t next_len = next.length;
+    modulated(next_modulation, modulation_value, next_start, next_len);
+    frozen(next_start, next_len, now.recorded);
+    next_start += now.read_head_offset;
+    // Same as play() will pick, and the first grain after a freeze has none
+    int32_t next_bias = first ? 0
+                              : follow(now.start, now.length, now.reversed,
+                                       now.bias, next_start, next_len,
+                                       next.reversed);
+
+    // The grain playing and the next one can each straddle a page at both
+    // ends of their part of the window, and the taps reach past it, so this
+    // keeps the window to at most one page over half the cache. follow()
+    // leaves that much room after the grain playing either way round.
+    int32_t t = now.position;
+    int32_t ahead = GRAIN_CACHE_SAMPLES / 2 - 3 * GRAIN_PAGE_SAMPLES;
+    if (t + ahead > now.length) {
+        // Fetched first, so if its pages share slots with the current
+        // grain's, the current grain wins
+        fetch(next_start, next_len, next.reversed, next_bias, 0,
+              min(t + ahead - now.length, next_len));
+    }
+    fetch(now.start, now.length, now.reversed, now.bias, t,
+          min(t + ahead, now.length));
+}
+
+void GrainHead::fetch(int32_t start, int32_t len, bool rev, int32_t bias,
+                      int32_t t0, int32_t t1) {
+    if (t1 <= t0) {
+        return;
+    }
+    if (rev) {
+        int32_t end = start + len;
+        cache->fetch(end - t1 - TAPS, end - 1 - t0 + TAPS, bias, true);
+    } else {
+        cache->fetch(start + t0 - TAPS, start + t1 + TAPS, bias, false);
+    }
+}
+
+int32_t GrainHead::follow(int32_t start, int32_t len, bool rev, int32_t bias,
+                          int32_t next_start, int32_t next_len,
+                          bool next_rev) {
+    // Every page fetch() may read for either direction
+    int32_t first = (start - TAPS) >> GRAIN_PAGE_BITS;
+    int32_t last = (start + len + TAPS) >> GRAIN_PAGE_BITS;
+    if (next_start == start && next_len == len &&
+        last - first < GRAIN_CACHE_PAGES) {
+        // The whole grain fits, so a repeat plays from the same slots
+        return bias;
+    }
+    // Slot the grain playing ends in, in the direction it plays
+    int32_t step = rev ? -1 : 1;
+    int32_t end = (rev ? first : last) + bias;
+    // The next grain starts in the slot after it. One going the other way
+    // starts half a cache on instead, and plays back towards it.
+    int32_t slot = next_rev == rev ? end + step
+                                   : end + step * (GRAIN_CACHE_PAGES / 2);
+    int32_t next_first =
+        next_rev ? (next_start + next_len + TAPS) >> GRAIN_PAGE_BITS
+                 : (next_start - TAPS) >> GRAIN_PAGE_BITS;
+    return (slot - next_first) & (GRAIN_CACHE_PAGES - 1);
+}
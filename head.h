@@ -0,0 +1,296 @@
+// head.h
+
+#include <Audio.h>
+
+#include "cache.h"
+#include "events.h"
+#include "grain.h"
+#include "handoff.h"
+#include "player.h"
+#include "ring.h"
+
+#pragma once
+
+#ifndef M_HEAD_H_
+#define M_HEAD_H_
+
+/**
+ * Which setting of a GrainHead follows the effect's modulation input.
+ */
+enum GrainModTarget {
+    GRAIN_MOD_NONE,
+    GRAIN_MOD_START,
+    GRAIN_MOD_LENGTH,
+    GRAIN_MOD_SPEED
+};
+
+struct GrainModulation {
+    uint8_t target;
+    // Start grid or length beat in samples, or non-zero for speeds in whole
+    // octaves. 0 leaves the setting unquantized.
+    int32_t quantum;
+};
+
+/**
+ * A freeze read head over a GrainRing. Each head has its own offset, length,
+ * speed, direction and window, and its own freeze: the oldest sample in the
+ * ring when the head starts becomes the start of its frozen buffer.
+ *
+ * Heads are owned and played by GrainScrubEffectCircular, which also keeps
+ * the ring's writer clear of every running head's frozen region.
+ *
+ * A head over storage that isn't mapped plays from its GrainCache, and
+ * outputs silence for any block whose pages haven't been prefetched yet.
+ *
+ * Nothing here masks interrupts. The setters publish whole GrainSettings
+ * through a GrainHandoff, start() and stop() post a single word that the
+ * audio interrupt acts on at its next block, and the interrupt publishes
+ * its playback position back the same way for prefetch().
+ *
+ * The schedule*() calls post the same changes as timestamped events instead,
+ * which take effect at an exact sample. Offset, length and direction still
+ * only change at the next grain boundary after they're due, and speed
+ * changes straight away. Calling the matching setter before an event is due
+ * publishes the event's value early.
+ *
+ * The modulate*() calls hand one setting over to the effect's modulation
+ * input instead. Its value is read once per block and taken up at the next
+ * grain boundary, the same as the setter given that value.
+ */
+class GrainHead : public GrainPlayer<GrainHead> {
+   public:
+    GrainHead(void)
+        : ring(NULL), cache(NULL), events(NULL), request(0), running(false) {}
+
+    /**
+     * @param ring_def Capture ring to play from
+     * @param cache_def Cache to play from when the ring's storage isn't
+     *                  mapped
+     */
+    void begin(GrainRing *ring_def, GrainCache *cache_def = NULL);
+
+    void start(void);
+    void stop(void);
+
+    /**
+     * Whether the head was playing at the end of the last block.
+     */
+    bool isRunning(void) { return running; }
+
+    /**
+     * Schedules start(), stop() or one of the setters for an exact sample,
+     * as counted by GrainScrubEffectCircular::now(). A time that has already
+     * passed takes effect at the start of the next block.
+     *
+     * @return Whether there was room in the event queue
+     */
+    bool scheduleStart(uint32_t time) {
+        return post(time, GRAIN_EVENT_START, 0);
+    }
+    bool scheduleStop(uint32_t time) {
+        return post(time, GRAIN_EVENT_STOP, 0);
+    }
+    bool scheduleStartPos(uint32_t time, float pos) {
+        stageStartPos(pos);
+        return post(time, GRAIN_EVENT_OFFSET, next.offset);
+    }
+    bool scheduleLengthPos(uint32_t time, float pos) {
+        stageLengthPos(pos);
+        return post(time, GRAIN_EVENT_LENGTH, next.length);
+    }
+    bool scheduleSpeed(uint32_t time, float ratio) {
+        next.rate = speedRate(ratio);
+        return post(time, GRAIN_EVENT_SPEED, next.rate);
+    }
+    bool scheduleReverse(uint32_t time, bool reversed) {
+        next.reversed = reversed;
+        return post(time, GRAIN_EVENT_DIRECTION, reversed);
+    }
+
+    /**
+     * Makes the start position follow the modulation input, where 0.0 to
+     * 1.0 is the whole ring as for setStartPos().
+     *
+     * @param grid Snaps the start to multiples of this many samples, or 0
+     */
+    void modulateStart(int32_t grid = 0) {
+        publishModulation(GRAIN_MOD_START, grid);
+    }
+
+    /**
+     * Makes the end of the grain follow the modulation input, as for
+     * setLengthPos().
+     *
+     * @param beat Snaps the end to this many samples times a power of two,
+     *             up to four octaves either way, or 0
+     */
+    void modulateLength(int32_t beat = 0) {
+        publishModulation(GRAIN_MOD_LENGTH, beat);
+    }
+
+    /**
+     * Makes the speed follow the modulation input, three octaves either side
+     * of 1.0 and limited like setSpeed().
+     *
+     * @param octaves Whether to snap the speed to whole octaves
+     */
+    void modulateSpeed(bool octaves = false) {
+        publishModulation(GRAIN_MOD_SPEED, octaves);
+    }
+
+    /**
+     * Hands the modulated setting back to its setter, which should be
+     * called to set it again.
+     */
+    void unmodulate(void) { publishModulation(GRAIN_MOD_NONE, 0); }
+
+   private:
+    friend class GrainScrubEffectCircular;
+
+    friend class GrainPlayer<GrainHead>;
+
+    // The writer is kept clear of the frozen region instead
+    bool accepts(int32_t, int32_t) { return true; }
+    int32_t recordHead(void) { return ring->write_head; }
+
+    bool post(uint32_t time, GrainEventType type, int32_t value);
+
+    /**
+     * Publishes the modulation if it changed, so it can be called every
+     * control tick.
+     */
+    void publishModulation(GrainModTarget target, int32_t quantum);
+
+    /**
+     * Takes the modulation input's value for this block, from 0 to 32767.
+     */
+    void modulate(int32_t value);
+
+    /**
+     * Applies a modulation to a grain's start and length, or to its speed.
+     */
+    void modulated(const GrainModulation &mod, int32_t value, int32_t &start,
+                   int32_t &len) const;
+    int32_t modulatedRate(const GrainModulation &mod, int32_t value) const;
+
+    /**
+     * Applies an event that's due.
+     *
+     * @param from Oldest sample in the ring at the time of the event
+     */
+    void apply(const GrainEvent &event, int32_t from);
+
+    /**
+     * Plays the current grain into out, latching the next offset, length,
+     * speed and direction each time the grain repeats.
+     */
+    void play(int16_t *out, int n);
+
+    /**
+     * Moves the latest published settings into the current grain.
+     */
+    void latch(void);
+
+    /**
+     * Moves a grain's start and length inside the frozen audio.
+     *
+     * @param since Samples recorded since the freeze
+     */
+    void frozen(int32_t &start, int32_t &len, int32_t since);
+
+    /**
+     * Picks up start() and stop() at the start of a block.
+     */
+    void sync(void);
+
+    /**
+     * Freezes the ring, starting from the given oldest sample.
+     */
+    void freeze(int32_t from);
+
+    /**
+     * Collects the current grain for the playback kernels.
+     */
+    GrainParams params(void);
+
+    /**
+     * Whether the cache holds everything the next n samples of the grain
+     * read.
+     */
+    bool cached(const GrainParams &grain, int n);
+
+    /**
+     * Fetches the rest of the current grain and the start of the next one
+     * into the cache, up to five pages ahead of the read head. Called from
+     * loop().
+     */
+    void prefetch(void);
+
+    /**
+     * Fetches samples from t0 to t1 of a grain, plus the interpolation taps.
+     */
+    void fetch(int32_t start, int32_t len, bool rev, int32_t bias, int32_t t0,
+               int32_t t1);
+
+    /**
+     * Picks the cache bias of the grain after one that's playing, so its
+     * first pages land in the slots after the ones the other ends in. The
+     * audio interrupt and prefetch() both call it, so they always agree.
+     *
+     * @param start Ring index of the first sample of the grain playing
+     * @param bias Cache bias of the grain playing
+     * @param next_start Ring index of the first sample of the next grain
+     */
+    static int32_t follow(int32_t start, int32_t len, bool rev, int32_t bias,
+                          int32_t next_start, int32_t next_len, bool next_rev);
+
+    /**
+     * What prefetch() needs of the grain being played.
+     */
+    struct Playback {
+        uint32_t synced;
+        int32_t start;
+        int32_t length;
+        int32_t position;
+        int32_t recorded;
+        int32_t read_head_offset;
+        int32_t bias;
+        bool reversed;
+    };
+
+    GrainRing *ring;
+    GrainCache *cache;
+    GrainEventQueue *events;
+    uint8_t index;
+
+    // Control side: the ring position and start count posted by start()
+    volatile int32_t freeze_from;
+    // Count of start() and stop() calls shifted up by one, or'd with whether
+    // the last one was a start, so both change in a single store
+    volatile uint32_t request;
+
+    // Control side: the modulation last published
+    GrainModulation next_modulation;
+
+    // Handed from the audio interrupt back to prefetch()
+    GrainHandoff<Playback> playback;
+
+    // Handed from the control loop to the audio interrupt
+    GrainHandoff<GrainModulation> modulations;
+
+    // Audio side
+    GrainModulation modulation;
+    uint32_t modulation_seen;
+    // Also read by prefetch(), a single word
+    volatile int32_t modulation_value;
+    uint32_t settings_seen;
+    uint32_t synced;
+    int32_t read_head_offset;
+    int32_t recorded;
+    int32_t guard;
+    // Pages the current grain is moved along by in the cache
+    int32_t bias;
+    volatile bool running;
+};
+
+#endif
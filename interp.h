@@ -0,0 +1,114 @@
+// interp.h
+
+#include <Arduino.h>
+
+#pragma once
+
+#ifndef M_INTERP_H_
+#define M_INTERP_H_
+
+/**
+ * Fixed-point interpolators for reading between samples of a grain.
+ *
+ * The weights are Q14 so every weight fits in a signed halfword, which lets
+ * two taps go through a single packed multiply-accumulate (SMLAD) on
+ * Cortex-M4/M7. Everywhere else the same sums are done one tap at a time.
+ * None of the sums can overflow 32 bits, so both paths give bit-identical
+ * output and the scalar path can be checked on any host. Define
+ * GRAIN_INTERP_SCALAR to force the scalar path on ARM too.
+ */
+enum GrainInterpolation {
+    GRAIN_INTERP_NONE,
+    GRAIN_INTERP_LINEAR,
+    GRAIN_INTERP_HERMITE
+};
+
+#if defined(__ARM_ARCH_7EM__) && !defined(GRAIN_INTERP_SCALAR)
+#define GRAIN_INTERP_PACKED
+#endif
+
+// computes ((hi << 16) | lo[15:0])
+static inline uint32_t grain_pack(int32_t lo, int32_t hi)
+    __attribute__((always_inline, unused));
+static inline uint32_t grain_pack(int32_t lo, int32_t hi) {
+#if defined(GRAIN_INTERP_PACKED)
+    uint32_t out;
+    asm volatile("pkhbt %0, %1, %2, lsl #16"
+                 : "=r"(out)
+                 : "r"(lo), "r"(hi));
+    return out;
+#else
+    return ((uint32_t)hi << 16) | ((uint32_t)lo & 0xFFFF);
+#endif
+}
+
+// computes sum + (a[15:0] * b[15:0]) + (a[31:16] * b[31:16])
+static inline int32_t grain_mac2(int32_t sum, uint32_t a, uint32_t b)
+    __attribute__((always_inline, unused));
+static inline int32_t grain_mac2(int32_t sum, uint32_t a, uint32_t b) {
+#if defined(GRAIN_INTERP_PACKED)
+    int32_t out;
+    asm volatile("smlad %0, %1, %2, %3"
+                 : "=r"(out)
+                 : "r"(a), "r"(b), "r"(sum));
+    return out;
+#else
+    return sum + (int32_t)(int16_t)a * (int16_t)b +
+           (int32_t)(int16_t)(a >> 16) * (int16_t)(b >> 16);
+#endif
+}
+
+// computes the signed 16 bit saturation of (val >> 14)
+static inline int32_t grain_saturate_q14(int32_t val)
+    __attribute__((always_inline, unused));
+static inline int32_t grain_saturate_q14(int32_t val) {
+#if defined(GRAIN_INTERP_PACKED)
+    int32_t out;
+    asm volatile("ssat %0, #16, %1, asr #14" : "=r"(out) : "r"(val));
+    return out;
+#else
+    val >>= 14;
+    if (val > 32767) {
+        return 32767;
+    } else if (val < -32768) {
+        return -32768;
+    }
+    return val;
+#endif
+}
+
+/**
+ * Linear interpolation between x0 and x1.
+ *
+ * @param frac Position between x0 and x1 as the low 16 bits of a 16.16
+ *             accumulator
+ */
+static inline int32_t grain_interpolate_linear(int32_t x0, int32_t x1,
+                                               uint32_t frac) {
+    int32_t t = (frac & 0xFFFF) >> 2;
+    return grain_mac2(8192, grain_pack(x0, x1), grain_pack(16384 - t, t)) >> 14;
+}
+
+/**
+ * 4-point, 3rd-order Hermite (Catmull-Rom) interpolation between x0 and x1.
+ * The curve can overshoot, so the result is saturated to 16 bits.
+ *
+ * @param frac Position between x0 and x1 as the low 16 bits of a 16.16
+ *             accumulator
+ */
+static inline int32_t grain_interpolate_hermite(int32_t xm1, int32_t x0,
+                                                int32_t x1, int32_t x2,
+                                                uint32_t frac) {
+    int32_t t = (frac & 0xFFFF) >> 2;
+    int32_t t2 = (t * t) >> 14;
+    int32_t t3 = (t2 * t) >> 14;
+    int32_t wm1 = (2 * t2 - t3 - t) >> 1;
+    int32_t w0 = (3 * t3 - 5 * t2 + 32768) >> 1;
+    int32_t w1 = (4 * t2 - 3 * t3 + t) >> 1;
+    int32_t w2 = (t3 - t2) >> 1;
+    int32_t sum = grain_mac2(8192, grain_pack(xm1, x0), grain_pack(wm1, w0));
+    sum = grain_mac2(sum, grain_pack(x1, x2), grain_pack(w1, w2));
+    return grain_saturate_q14(sum);
+}
+
+#endif
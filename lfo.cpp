@@ -1,89 +1,77 @@
 #include "lfo.h"
 
-int interpolate(int* input, int len, uint32_t index) {
-    int i = index >> 16;
-    int weight = index & 65535;
-    if (i >= len - 1) {
-        return input[len - 1];
-    }
-    return (input[i] * (65536 - weight) + input[i + 1] * weight) >> 16;
-}
-
-WavetableLFO::WavetableLFO(int duration, int length, int* tbl) {
-    _tbl = tbl;
-    _length = length;
+WavetableLFO::WavetableLFO(int duration, const LFOTable& tbl) {
+    _tbl = &tbl;
     set_time(duration);
 }
 
-void WavetableLFO::set_time(int duration) { _time = duration; }
+void WavetableLFO::set_time(int duration) {
+    _phase.set_period(duration * 1000);
+}
 
-void WavetableLFO::loop(unsigned long ms) {
-    unsigned long duration = ms - _last_ms;
-    _last_ms = ms;
-    _current_time += duration;
-    _increment = _current_time * (_length - 1) * 65536 / _time;
-    byte_value = interpolate(_tbl, _length, _increment);
+void WavetableLFO::loop(unsigned long us) {
+    byte_value = at(_phase.advance(us));
     value = (float)byte_value / 255.0;
-    if (_current_time >= _time) {
-        _current_time = 0;
-    }
 }
 
-void WavetableLFO::reset() { _current_time = 0; }
-
 WavetableMatrixLFO::WavetableMatrixLFO(int duration, byte matrix_length,
                                        WavetableLFO** matrix) {
     _matrix = matrix;
     _matrix_length = matrix_length;
+    _shape = 0;
     set_time(duration);
 }
 
 void WavetableMatrixLFO::set_time(int duration) {
-    for (byte i = 0; i < _matrix_length; i++) {
-        _matrix[i]->set_time(duration);
-    }
+    _phase.set_period(duration * 1000);
 }
 
-void WavetableMatrixLFO::loop(unsigned long ms) {
-    for (byte i = 0; i < _matrix_length; i++) {
-        _matrix[i]->loop(ms);
-    }
-    if (_index + 1 >= _matrix_length) {
-        value = _matrix[_index]->value;
-        return;
-    }
-
-    value = (1.0 - _ratio) * _matrix[_index]->value +
-            _ratio * _matrix[_index + 1]->value;
+void WavetableMatrixLFO::loop(unsigned long us) {
+    value = at(_phase.advance(us));
 }
 
-void WavetableMatrixLFO::reset() {
-    for (byte i = 0; i < _matrix_length; i++) {
-        _matrix[i]->reset();
+int32_t WavetableMatrixLFO::at_fine(uint32_t phase, uint32_t shape) {
+    uint32_t index = shape >> 16;
+    int32_t ratio = shape & 65535;
+    int32_t a = _matrix[index]->at_fine(phase);
+    if (index + 1 >= _matrix_length) {
+        return a;
     }
+    int32_t b = _matrix[index + 1]->at_fine(phase);
+    return a + (int32_t)(((int64_t)(b - a) * ratio) >> 16);
 }
 
-int TBL_SQUARE[TBL_SQUARE_LEN] = {
+
+static constexpr uint8_t TBL_SQUARE_POINTS[] = {
     255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
     255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0};
 
-int TBL_RAMP[TBL_RAMP_LEN] = {0, 51, 102, 153, 204, 255};
+static constexpr uint8_t TBL_RAMP_POINTS[] = {0, 51, 102, 153, 204, 255};
 
-int TBL_WOBBLE[TBL_WOBBLE_LEN] = {
+static constexpr uint8_t TBL_WOBBLE_POINTS[] = {
     0,   5,   10,  35,  75,  130, 185, 225, 240, 250, 255, 255, 200, 160, 130,
     105, 85,  70,  60,  50,  40,  32,  31,  30,  31,  32,  37,  50,  80,  110,
     130, 140, 145, 145, 100, 70,  45,  32,  25,  21,  19,  17,  16,  15,  14,
     13,  13,  12,  11,  10,  25,  50,  37,  16,  8,   4,   3,   2,   1,   0};
 
-int TBL_TRI[TBL_TRI_LEN] = {0,   51,  102, 153, 204, 255,
-                                  204, 153, 102, 51,  0};
+static constexpr uint8_t TBL_TRI_POINTS[] = {0,   51,  102, 153, 204, 255,
+                                             204, 153, 102, 51,  0};
 
-int TBL_REV_WOBBLE[TBL_REV_WOBBLE_LEN] = {
+static constexpr uint8_t TBL_REV_WOBBLE_POINTS[] = {
     0,   1,   2,   3,   4,   8,   16,  37,  50,  25,  10,  11,  12,  13,  13,
     14,  15,  16,  17,  19,  21,  25,  32,  45,  70,  100, 145, 145, 140, 130,
     110, 80,  50,  37,  32,  31,  30,  31,  32,  40,  50,  60,  70,  85,  105,
     130, 160, 200, 255, 255, 250, 240, 225, 185, 130, 75,  35,  10,  5,   0};
 
-int TBL_SAW[TBL_SAW_LEN] = {255, 204, 153, 102, 51, 0};
+static constexpr uint8_t TBL_SAW_POINTS[] = {255, 204, 153, 102, 51, 0};
+
+// Authored breakpoints are only used to build the tables, so they never
+// reach the binary.
+constexpr LFOTable TBL_SQUARE PROGMEM = lfo_table(TBL_SQUARE_POINTS);
+constexpr LFOTable TBL_RAMP PROGMEM = lfo_table(TBL_RAMP_POINTS);
+constexpr LFOTable TBL_WOBBLE PROGMEM = lfo_table(TBL_WOBBLE_POINTS);
+constexpr LFOTable TBL_TRI PROGMEM = lfo_table(TBL_TRI_POINTS);
+constexpr LFOTable TBL_REV_WOBBLE PROGMEM = lfo_table(TBL_REV_WOBBLE_POINTS);
+constexpr LFOTable TBL_SAW PROGMEM = lfo_table(TBL_SAW_POINTS);
@@ -7,41 +7,280 @@
 #ifndef M_LFO_H_
 #define M_LFO_H_
 
+enum LFOMode {
+    // Runs continuously and ignores trigger()
+    LFO_FREE,
+    // Runs one cycle from each trigger() and holds its last value
+    LFO_ONE_SHOT,
+    // Runs continuously, and trigger() restarts the cycle
+    LFO_RETRIGGER
+};
+
+/**
+ * Fixed-point phase accumulator, clocked by any free-running counter such as
+ * micros() or a sample count. A full cycle is the whole 32-bit range, so
+ * wrapping is free, and each tick is one multiply.
+ * The increment is only recalculated when the period actually changes,
+ * without a divide, and the phase is never touched by a period change, so
+ * changing speed doesn't make the LFO jump.
+ */
+class LFOPhase {
+   public:
+    LFOPhase(void)
+        : _phase(0),
+          _increment(0),
+          _period(0),
+          _last(0),
+          _mode(LFO_FREE),
+          _running(true) {}
+
+    /**
+     * @param period Length of a cycle in clock ticks
+     */
+    void set_period(uint32_t period) {
+        if (period == _period || period == 0) {
+            return;
+        }
+        _period = period;
+        _increment = reciprocal(period, _increment);
+    }
+
+    void set_mode(LFOMode mode) {
+        _mode = mode;
+        if (mode != LFO_ONE_SHOT) {
+            _running = true;
+        }
+    }
+
+    /**
+     * Moves the phase on to the given time.
+     *
+     * @param now Current clock count
+     * @return Position in the cycle, from 0 to 65536
+     */
+    uint32_t advance(uint32_t now) {
+        uint32_t elapsed = now - _last;
+        _last = now;
+        if (!_running) {
+            return 65536;
+        }
+        uint64_t next = (uint64_t)_phase + (uint64_t)elapsed * _increment;
+        if (next > 0xFFFFFFFF && _mode == LFO_ONE_SHOT) {
+            _running = false;
+            return 65536;
+        }
+        _phase = next;
+        return _phase >> 16;
+    }
+
+    /**
+     * Restarts the cycle in the one-shot and retrigger modes.
+     */
+    void trigger(void) {
+        if (_mode != LFO_FREE) {
+            reset();
+        }
+    }
+
+    /**
+     * Restarts the cycle in any mode.
+     */
+    void reset(void) {
+        _phase = 0;
+        _running = true;
+    }
+
+    /**
+     * Works out 0xFFFFFFFF / period, rounded down, with Newton-Raphson steps
+     * instead of a divide. Rates usually move a little at a time, so the
+     * last increment is a close first guess and one or two steps do. After
+     * a bigger jump it starts from 2^32 over the next power of two up, and
+     * takes up to six.
+     *
+     * @param guess Roughly the answer, or anything if it isn't known
+     */
+    static uint32_t reciprocal(uint32_t period, uint32_t guess) {
+        const uint64_t one = 1ULL << 32;
+        uint64_t x = guess;
+        int64_t error = one - (uint64_t)period * x;
+        if (x == 0 || error >= (1LL << 31) || error <= -(1LL << 31)) {
+            // Within 2x of the answer
+            x = one >> (32 - __builtin_clz(period));
+            error = one - (uint64_t)period * x;
+        }
+        for (int i = 0; i < 6 && error != 0; i++) {
+            int64_t step = ((int64_t)x * error) >> 32;
+            if (step == 0) {
+                break;
+            }
+            x += step;
+            error = one - (uint64_t)period * x;
+        }
+        // Newton lands within a step of the answer, and these settle it
+        while (x > 0 && (uint64_t)period * x > 0xFFFFFFFF) {
+            x--;
+        }
+        while ((uint64_t)period * (x + 1) <= 0xFFFFFFFF) {
+            x++;
+        }
+        return x;
+    }
+
+   private:
+    uint32_t _phase;
+    uint32_t _increment;
+    uint32_t _period;
+    uint32_t _last;
+    LFOMode _mode;
+    bool _running;
+};
+
+/**
+ * Entries per LFO table. Tables are resampled to this power of two so a
+ * lookup is a shift and a mask, and carry two guard entries holding the
+ * final value so interpolating past the end never needs a bounds check.
+ */
+#define LFO_TABLE_BITS 8
+#define LFO_TABLE_SIZE (1 << LFO_TABLE_BITS)
+
+struct LFOTable {
+    uint8_t data[LFO_TABLE_SIZE + 2];
+};
+
+/**
+ * Builds an LFOTable from authored breakpoints, spread evenly over one cycle
+ * and linearly interpolated. The built-in tables are built at compile time,
+ * tables loaded at runtime by LFOBank use the same code.
+ *
+ * @param points Values from 0 to 255, the first at the start of the cycle
+ *               and the last at its end
+ * @param n Number of points, at least one
+ */
+constexpr LFOTable lfo_table(const uint8_t* points, uint32_t n) {
+    LFOTable table = {};
+    for (uint32_t i = 0; i < LFO_TABLE_SIZE + 2; i++) {
+        // 16.16 position within the breakpoints
+        uint32_t index = i >= LFO_TABLE_SIZE
+                             ? (n - 1) << 16
+                             : (i * (n - 1) << 16) / LFO_TABLE_SIZE;
+        uint32_t p = index >> 16;
+        uint32_t weight = index & 65535;
+        if (p >= n - 1) {
+            table.data[i] = points[n - 1];
+        } else {
+            table.data[i] = (points[p] * (65536 - weight) +
+                             points[p + 1] * weight + 32768) >>
+                            16;
+        }
+    }
+    return table;
+}
+
+template <size_t N>
+constexpr LFOTable lfo_table(const uint8_t (&points)[N]) {
+    return lfo_table(points, N);
+}
+
 /**
  * Wavetable-based LFO. Interpolates the position within the wavetable, so the
  * larger the wavetable is, the more accurate it will be.
  */
 class WavetableLFO {
    public:
-    WavetableLFO(int duration, int length, int* tbl);
-    void loop(unsigned long ms);
-    void reset(void);
+    WavetableLFO(int duration, const LFOTable& tbl);
+
+    /**
+     * Swaps in another table without moving the phase.
+     */
+    void set_table(const LFOTable& tbl) { _tbl = &tbl; }
+
+    /**
+     * @param us Current time from micros()
+     */
+    void loop(unsigned long us);
+    void reset(void) { _phase.reset(); }
+    void trigger(void) { _phase.trigger(); }
+    void set_mode(LFOMode mode) { _phase.set_mode(mode); }
+
+    /**
+     * @param duration Length of a cycle in milliseconds
+     */
     void set_time(int duration);
+
+    /**
+     * Reads the wavetable at a point in the cycle, without moving the LFO.
+     *
+     * @param phase Position in the cycle, from 0 to 65536
+     * @return Value from 0 to 255
+     */
+    int at(uint32_t phase) { return at_fine(phase) >> 8; }
+
+    /**
+     * Same as at(), with 8 more bits of resolution so audio-rate readers
+     * don't step between table values.
+     *
+     * @return Value from 0 to 65280
+     */
+    int32_t at_fine(uint32_t phase) {
+        uint32_t i = phase >> (16 - LFO_TABLE_BITS);
+        int32_t weight = phase & ((1 << (16 - LFO_TABLE_BITS)) - 1);
+        const uint8_t* tbl = _tbl->data;
+        return tbl[i] * (256 - weight) + tbl[i + 1] * weight;
+    }
+
     float value;
     int byte_value;
 
    private:
-    unsigned long _last_ms;
-    uint32_t _time;
-    uint32_t _current_time;
-    uint32_t _increment;
-    int _index;
-    int* _tbl;
-    uint32_t _length;
+    LFOPhase _phase;
+    const LFOTable* _tbl;
 };
 
 /**
  * Two-dimensional wavetable LFO. The shape of the wavetable determines the
  * interpolation between the current index and the next, so the shapes mix with
  * each other.
+ *
+ * The matrix keeps the only phase, and only reads the two tables being mixed
+ * with WavetableLFO::at(), so the cost of a tick doesn't grow with the number
+ * of shapes. The tables' own loop() and timing aren't used. Changing the
+ * shape or the time never moves the phase.
  */
 class WavetableMatrixLFO {
    public:
     WavetableMatrixLFO(int duration, byte matrix_length, WavetableLFO** matrix);
     float value;
-    void loop(unsigned long ms);
-    void reset(void);
+
+    /**
+     * @param us Current time from micros()
+     */
+    void loop(unsigned long us);
+    void reset(void) { _phase.reset(); }
+    void trigger(void) { _phase.trigger(); }
+    void set_mode(LFOMode mode) { _phase.set_mode(mode); }
+
+    /**
+     * @param duration Length of a cycle in milliseconds
+     */
     void set_time(int duration);
+    /**
+     * Mixes the two current tables at a point in the cycle, without moving
+     * the LFO.
+     *
+     * @param phase Position in the cycle, from 0 to 65536
+     * @return Value from 0.0 to 1.0
+     */
+    float at(uint32_t phase) { return at_fine(phase, shape()) / 65280.0; }
+
+    /**
+     * Same as at(), in fixed point, for a shape() read earlier. Audio-rate
+     * readers read the shape once per block, so every sample in the block
+     * mixes the same two tables.
+     *
+     * @return Value from 0 to 65280
+     */
+    int32_t at_fine(uint32_t phase, uint32_t shape);
+
     void set_shape(float position) {
         if (position <= 0.0) {
             position = 0.0;
@@ -50,28 +289,34 @@ class WavetableMatrixLFO {
             position = 1.0;
         }
         float pos = position * (_matrix_length - 0.8);
-        _index = pos;
-        _ratio = pos - _index;
+        uint32_t index = pos;
+        uint32_t ratio = (pos - index) * 65536.0;
+        if (ratio > 65535) {
+            ratio = 65535;
+        }
+        _shape = index << 16 | ratio;
     }
 
+    /**
+     * @return The current table index shifted up 16 bits, or'd with the
+     *         ratio of the next table mixed in as Q16. One word, so it's
+     *         always read whole.
+     */
+    uint32_t shape(void) { return _shape; }
+
    private:
-    unsigned int _index;
-    float _ratio;
+    LFOPhase _phase;
+    volatile uint32_t _shape;
     WavetableLFO** _matrix;
     byte _matrix_length;
 };
 
-#define TBL_SQUARE_LEN 60
-extern int TBL_SQUARE[TBL_SQUARE_LEN];
-#define TBL_RAMP_LEN 6
-extern int TBL_RAMP[TBL_RAMP_LEN];
-#define TBL_WOBBLE_LEN 60
-extern int TBL_WOBBLE[TBL_WOBBLE_LEN];
-#define TBL_TRI_LEN 11
-extern int TBL_TRI[TBL_TRI_LEN];
-#define TBL_REV_WOBBLE_LEN 60
-extern int TBL_REV_WOBBLE[TBL_REV_WOBBLE_LEN];
-#define TBL_SAW_LEN 6
-extern int TBL_SAW[TBL_SAW_LEN];
+// Built at compile time and kept in flash
+extern const LFOTable TBL_SQUARE;
+extern const LFOTable TBL_RAMP;
+extern const LFOTable TBL_WOBBLE;
+extern const LFOTable TBL_TRI;
+extern const LFOTable TBL_REV_WOBBLE;
+extern const LFOTable TBL_SAW;
 
 #endif
@@ -0,0 +1,44 @@
+#include "modulation.h"
+
+#include <Arduino.h>
+
+void ModulationLFO::update(void) {
+    audio_block_t *block = allocate();
+    if (!block) {
+        return;
+    }
+
+    uint8_t requested = mode_request;
+    if (requested != mode) {
+        mode = requested;
+        phase.set_mode((LFOMode)mode);
+    }
+    if (triggered) {
+        triggered = false;
+        phase.trigger();
+    }
+
+    // Read once, so set_shape() and the setters can't change them part way
+    // through the block
+    int32_t centre = offset_q15;
+    int32_t depth = depth_q15;
+    uint32_t shape = matrix->shape();
+    int32_t out = 0;
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        // lfo - 0.5 as Q15, from -16384 to 16383. 32896 / 65536 is 32768 /
+        // 65280 to within 0.002%.
+        uint32_t fine = matrix->at_fine(phase.advance(clock++), shape);
+        int32_t lfo = (int32_t)((fine * 32896) >> 16) - 16384;
+        out = centre + ((lfo * depth) >> 15);
+        if (out < 0) {
+            out = 0;
+        } else if (out > 32767) {
+            out = 32767;
+        }
+        block->data[i] = out;
+    }
+    last = out / 32767.0;
+
+    transmit(block);
+    release(block);
+}
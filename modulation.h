@@ -0,0 +1,101 @@
+// modulation.h
+
+#include <Audio.h>
+
+#include "lfo.h"
+
+#pragma once
+
+#ifndef M_MODULATION_H_
+#define M_MODULATION_H_
+
+/**
+ * Renders a WavetableMatrixLFO at audio rate, so the modulation it drives
+ * moves smoothly within every block instead of stepping each time loop()
+ * gets round to it.
+ *
+ * The output is offset + (lfo - 0.5) * depth, clamped to 0.0 to 1.0 and
+ * scaled to 0 to 32767. That's a unipolar control signal, ready for inputs
+ * like AudioFilterStateVariable's frequency control, or the modulation
+ * inputs of GrainScrubEffectCircular and GrainCloudEffect, which read it
+ * once per block. Parameters that only have a setter can take read(), which
+ * is the value at the end of the last block.
+ *
+ * The matrix only supplies the tables and the shape, which can still be set
+ * with its set_shape(). Timing lives here and is counted in samples. The
+ * matrix's own loop() needn't be called.
+ */
+class ModulationLFO : public AudioStream {
+   public:
+    ModulationLFO(WavetableMatrixLFO *matrix_def)
+        : AudioStream(0, NULL),
+          matrix(matrix_def),
+          clock(0),
+          duration_ms(0),
+          offset_q15(16384),
+          depth_q15(32767),
+          last(0.5),
+          triggered(false),
+          mode_request(LFO_FREE),
+          mode(LFO_FREE) {}
+
+    /**
+     * @param duration Length of a cycle in milliseconds
+     */
+    void set_time(int duration) {
+        if (duration == duration_ms) {
+            return;
+        }
+        duration_ms = duration;
+        phase.set_period(duration * AUDIO_SAMPLE_RATE_EXACT * 0.001);
+    }
+
+    /**
+     * Changes the mode at the next block.
+     */
+    void set_mode(LFOMode mode_def) { mode_request = mode_def; }
+
+    /**
+     * Restarts the cycle at the next block, in the one-shot and retrigger
+     * modes.
+     */
+    void trigger(void) { triggered = true; }
+
+    /**
+     * @param value Centre of the modulation, from 0.0 to 1.0
+     */
+    void offset(float value) { offset_q15 = clamp(value) * 32767.0; }
+
+    /**
+     * @param value Peak-to-peak size of the modulation, from 0.0 to 1.0
+     */
+    void depth(float value) { depth_q15 = clamp(value) * 32767.0; }
+
+    /**
+     * @return The output at the end of the last block, from 0.0 to 1.0
+     */
+    float read(void) { return last; }
+
+    virtual void update(void);
+
+   private:
+    static float clamp(float value) {
+        return value < 0.0 ? 0.0 : (value > 1.0 ? 1.0 : value);
+    }
+
+    WavetableMatrixLFO *matrix;
+    LFOPhase phase;
+    // Samples rendered so far, the clock for phase
+    uint32_t clock;
+    // Cycle length last set, so an unchanged one is skipped
+    int duration_ms;
+    volatile int32_t offset_q15;
+    volatile int32_t depth_q15;
+    volatile float last;
+    volatile bool triggered;
+    // Mode set from loop(), and the one the phase was last given
+    volatile uint8_t mode_request;
+    uint8_t mode;
+};
+
+#endif
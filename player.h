@@ -0,0 +1,373 @@
+// player.h
+
+#include <Audio.h>
+
+#include "grain.h"
+#include "handoff.h"
+
+#pragma once
+
+#ifndef M_PLAYER_H_
+#define M_PLAYER_H_
+
+/**
+ * Calculates an integer playback rate from a float value, limited to three
+ * octaves down and two up.
+ *
+ * @param ratio Speed of playback where 1.0 is the standard sample rate
+ */
+static inline int32_t grain_speed_rate(float ratio) {
+    if (ratio < 0.125)
+        ratio = 0.125;
+    else if (ratio > 4.0)
+        ratio = 4.0;
+    return ratio * 65536.0 + 0.499;
+}
+
+/**
+ * @param pos Fraction of the buffer, up to 0.99 of it
+ * @param max_len Length of the buffer grains are played from
+ * @return Offset of a grain starting at pos
+ */
+static inline int32_t grain_start_offset(float pos, int32_t max_len) {
+    if (pos < 0.0)
+        pos = 0.0;
+    else if (pos > 0.99)
+        pos = 0.99;
+    return pos * max_len;
+}
+
+/**
+ * @param pos Fraction of the buffer the grain ends at
+ * @param max_len Length of the buffer grains are played from
+ * @param offset Offset of the grain
+ * @return Length of the grain, or the rest of the buffer when pos is less
+ *         than 50 samples after offset
+ */
+static inline int32_t grain_end_length(float pos, int32_t max_len,
+                                       int32_t offset) {
+    if (pos < 0.01)
+        pos = 0.01;
+    else if (pos > 1.0)
+        pos = 1.0;
+    int32_t length = (max_len * pos) - offset;
+    if (length < 50) {
+        length = max_len - offset - 1;
+    }
+    return length;
+}
+
+/**
+ * Settings and playback state shared by every freeze read head, whatever
+ * records the audio it plays. GrainScrubEffect and GrainHead both derive
+ * from it, naming themselves as the Recorder.
+ *
+ * The Recorder is resolved at compile time, not through virtual calls. It
+ * must provide:
+ *
+ * - bool accepts(int32_t offset, int32_t length): whether a grain can be
+ *   set yet. A one-shot recorder refuses grains it hasn't finished
+ *   recording.
+ * - int32_t recordHead(void): the write head shown by debug().
+ *
+ * The setters publish whole GrainSettings from the control loop. The
+ * recorder's audio interrupt reads them, decides the grain's offset and
+ * length, and then calls latchPlayback() for everything else.
+ */
+template <class Recorder>
+class GrainPlayer {
+   public:
+    /**
+     * Calculates a integer playback rate from a float value. The rate is
+     * always positive; use reverse() to play a grain backwards.
+     *
+     * @param ratio Speed of playback where 1.0 is the standard sample rate
+     */
+    void setSpeed(float ratio) {
+        next.rate = speedRate(ratio);
+        settings.publish(next);
+    }
+
+    /**
+     * Reverses the current playback speed.
+     */
+    void reverse(void) {
+        next.reversed = true;
+        settings.publish(next);
+    }
+    void forward(void) {
+        next.reversed = false;
+        settings.publish(next);
+    }
+
+    /**
+     * Sets the start position based on a millisecond value. Useful when
+     * the position needs to be quantized to a beat.
+     *
+     * @param ms Milliseconds from the start of the delay sample
+     */
+    void setStartMs(float ms) {
+        if (ms < 0.0) {
+            ms = 0.0;
+        } else if (ms > length_ms) {
+            ms = length_ms - 1.0;
+        }
+        int32_t new_offset = ms * AUDIO_SAMPLE_RATE_EXACT * 0.001;
+        if (!recorder().accepts(new_offset, length)) {
+            return;
+        }
+        next.offset = new_offset;
+        if (ideal_length + next.offset > max_sample_len) {
+            next.length = max_sample_len - next.offset;
+        } else {
+            next.length = ideal_length;
+        }
+        settings.publish(next);
+    }
+
+    /**
+     * Sets the start position based on a fractional value based
+     * on the full delay buffer length.
+     *
+     * @param pos Fraction of the max delay time
+     */
+    void setStartPos(float pos) {
+        if (stageStartPos(pos)) {
+            settings.publish(next);
+        }
+    }
+
+    /**
+     * Sets the length based on a millisecond value. Useful when
+     * the length needs to be quantized to a beat.
+     *
+     * @param ms Millisecond length of the sample playback
+     */
+    void setLengthMs(float ms) {
+        if (ms < 1.0) {
+            ms = 1.0;
+        } else if (ms > length_ms) {
+            ms = length_ms;
+        }
+        int32_t new_length = (ms * AUDIO_SAMPLE_RATE_EXACT * 0.001) - offset;
+        if (new_length < 50) {
+            new_length = max_sample_len - offset - 1;
+        }
+        if (!recorder().accepts(offset, new_length)) {
+            return;
+        }
+        next.length = new_length;
+
+        // Ideal length keeps the true length, even if the start time
+        ideal_length = next.length;
+        settings.publish(next);
+    }
+
+    /**
+     * Sets the start position based on a fractional value based
+     * on the full delay buffer length.
+     *
+     * @param pos Fraction of the max delay time
+     */
+    void setLengthPos(float pos) {
+        if (stageLengthPos(pos)) {
+            settings.publish(next);
+        }
+    }
+
+    /**
+     * Sets the shape of the fade applied to both ends of every grain.
+     *
+     * @param shape One of the GrainWindowShape values
+     */
+    void setFadeShape(GrainWindowShape shape) {
+        next.window = grain_window(shape);
+        settings.publish(next);
+    }
+
+    /**
+     * Sets the length of the fade at each end of a grain. Longer fades cost
+     * no extra CPU, and are shortened to half the grain for short grains.
+     *
+     * @param ms Millisecond length of each fade
+     */
+    void setFadeMs(float ms) {
+        if (ms < 0.0) {
+            ms = 0.0;
+        } else if (ms > length_ms / 2) {
+            ms = length_ms / 2;
+        }
+        next.fade = ms * AUDIO_SAMPLE_RATE_EXACT * 0.001;
+        settings.publish(next);
+    }
+
+    /**
+     * Sets how the read head reads between samples when the speed isn't
+     * 1.0. Linear and Hermite interpolation use the fractional part of the
+     * playback position instead of dropping it.
+     *
+     * @param mode One of the GrainInterpolation values
+     */
+    void setInterpolation(GrainInterpolation mode) {
+        next.interpolation = mode;
+        settings.publish(next);
+    }
+
+    void debug(void) {
+        Serial.print("Max Sample Length: ");
+        Serial.println(max_sample_len);
+        Serial.print("Accumulator: ");
+        Serial.println(accumulator >> 16);
+        Serial.print("Write Head: ");
+        Serial.println(recorder().recordHead());
+        Serial.print("Read Head: ");
+        Serial.println(read_head);
+        Serial.print("Offset: ");
+        Serial.print(next.offset);
+        Serial.print(" -> ");
+        Serial.println(offset);
+        Serial.print("Length: ");
+        Serial.print(next.length);
+        Serial.print(" -> ");
+        Serial.println(length);
+        Serial.print("Playback Rate: ");
+        Serial.print(next.rate);
+        Serial.print(" -> ");
+        Serial.println(playback_rate);
+        Serial.print("Reversed: ");
+        Serial.print(next.reversed);
+        Serial.print(" -> ");
+        Serial.println(reversed);
+    }
+
+   protected:
+    Recorder &recorder(void) { return *static_cast<Recorder *>(this); }
+
+    /**
+     * Resets the playback state and publishes the default settings.
+     *
+     * @param max_len Length of the buffer grains are played from
+     */
+    void beginPlayer(int32_t max_len) {
+        setMaxLength(max_len);
+        offset = 0;
+        length = 0;
+        read_head = 0;
+        playback_rate = 65536;
+        accumulator = 0;
+        position = 0;
+        reversed = false;
+        window = grain_window(GRAIN_WINDOW_LINEAR);
+        fade = 0;
+        window_step = 0;
+        interpolation = GRAIN_INTERP_NONE;
+
+        next.offset = 0;
+        next.length = 0;
+        next.rate = 65536;
+        next.fade = GRAIN_FADE_SAMPLES;
+        next.window = window;
+        next.reversed = false;
+        next.interpolation = GRAIN_INTERP_NONE;
+        ideal_length = next.length;
+        latched = next;
+        settings.publish(next);
+    }
+
+    void setMaxLength(int32_t max_len) {
+        max_sample_len = max_len;
+        length_ms = ((float)max_sample_len / AUDIO_SAMPLE_RATE_EXACT) * 1000;
+    }
+
+    static int32_t speedRate(float ratio) { return grain_speed_rate(ratio); }
+
+    /**
+     * Updates next without publishing it.
+     *
+     * @return Whether the recorder accepted the change
+     */
+    bool stageStartPos(float pos) {
+        int32_t new_offset = grain_start_offset(pos, max_sample_len);
+        if (!recorder().accepts(new_offset, length)) {
+            return false;
+        }
+        next.offset = new_offset;
+        if (ideal_length + next.offset > max_sample_len) {
+            next.length = max_sample_len - next.offset - 1;
+        } else {
+            next.length = ideal_length;
+        }
+        return true;
+    }
+
+    bool stageLengthPos(float pos) {
+        int32_t new_length = grain_end_length(pos, max_sample_len, offset);
+        if (!recorder().accepts(offset, new_length)) {
+            return false;
+        }
+        next.length = new_length;
+        ideal_length = next.length;
+        return true;
+    }
+
+    /**
+     * Takes everything but the offset and length from the latched settings,
+     * once the recorder has set those.
+     */
+    void latchPlayback(void) {
+        playback_rate = latched.rate;
+        reversed = latched.reversed;
+        fade = min(latched.fade, length / 2);
+        window = latched.window;
+        window_step = grain_window_step(fade);
+        interpolation = latched.interpolation;
+    }
+
+    /**
+     * Collects the current grain for the playback kernels.
+     *
+     * @param bank Buffer to read from
+     * @param mask Mask of the buffer, see GrainParams
+     * @param start Index of the first sample of the grain in the buffer
+     */
+    GrainParams grainParams(const int16_t *bank, int32_t mask,
+                            int32_t start) const {
+        GrainParams grain;
+        grain.bank = bank;
+        grain.mask = mask;
+        grain.start = start;
+        grain.length = length;
+        grain.rate = playback_rate;
+        grain.fade = fade;
+        grain.window = window;
+        grain.window_step = window_step;
+        grain.reversed = reversed;
+        grain.interpolation = interpolation;
+        return grain;
+    }
+
+    // Control side: settings being edited
+    GrainSettings next;
+    int32_t ideal_length;
+
+    // Handed from the control loop to the audio interrupt
+    GrainHandoff<GrainSettings> settings;
+
+    // Audio side
+    GrainSettings latched;
+    const int16_t *window;
+    uint32_t window_step;
+    int32_t playback_rate;
+    uint32_t accumulator;
+    int32_t position;
+    int32_t max_sample_len;
+    int32_t read_head;
+    int32_t offset;
+    int32_t length;
+    int32_t fade;
+    float length_ms;
+    bool reversed;
+    GrainInterpolation interpolation;
+};
+
+#endif
@@ -4,13 +4,20 @@
 #include <SerialFlash.h>
 #include <Wire.h>
 
+#include "bank.h"
 #include "control.h"
 #include "circular.h"
+#include "cloud.h"
 #include "lfo.h"
+#include "modulation.h"
 
-#define GRANULAR_DELAY 20000
-#define READ_AVERAGE 8
-#define READ_RESOLUTION 12
+// Keep this a power of two so no part of the grain ring goes unused. 16384
+// samples is about 371 ms, down from the 20000 (about 453 ms) this used to
+// be, see the README.
+#define GRANULAR_DELAY 16384
+
+// Clocked start positions snap to this many steps per beat
+#define CLOCK_GRID 16
 #define WRITE_RESOLUTION 12
 #define TOTAL_MIXERS 4
 
@@ -18,6 +25,7 @@
 AudioInputI2S i2s2;                  // xy=66,126
 AudioEffectGranular granular_l;      // xy=185,79
 GrainScrubEffectCircular scrub_l;    // CUSTOM
+GrainCloudEffect cloud_l;            // CUSTOM
 AudioSynthWaveformSine sine_l;       // xy=311,126
 AudioEffectMultiply mult_l;          // xy=430,99
 AudioEffectBitcrusher bitcrusher_l;  // xy=668,119
@@ -27,6 +35,7 @@ AudioOutputI2S i2s1;                 // xy=1159,161
 AudioConnection patchCord1(i2s2, 0, scrub_l, 0);  // CUSTOM
 AudioConnection patchCord2(i2s2, 0, mixers[0], 0);
 AudioConnection patchCord3(scrub_l, 0, mixers[0], 1);  // CUSTOM
+AudioConnection patchCord18(cloud_l, 0, mixers[0], 2);  // CUSTOM
 AudioConnection patchCord4(mixers[0], 0, mult_l, 0);
 AudioConnection patchCord5(mixers[0], 0, mixers[1], 0);
 AudioConnection patchCord6(sine_l, 0, mult_l, 1);
@@ -60,6 +69,7 @@ const int PIN_TRIG2 = 2;
 const int PIN_TRIG3 = 3;
 const int PIN_TRIG4 = 4;
 const int PIN_MODE_BTN = 12;
+const int PIN_CLOCK = 0;
 
 // LEDs
 const int PIN_TRIG_LED1 = 5;
@@ -79,12 +89,10 @@ float ctrl_offset = 0.0;
 float ctrl_waveshape = 0.0;
 float ctrl_speed = 0.0;
 float ctrl_depth = 0.0;
-float lfo_mod = 0.0;
 float freeze_speed = 1.0;
 float mod = 0.0;
 
 int crush_sample_rate = 44100;
-int filter_frequency = 15000;
 float amp_mod_frequency = 440.0;
 
 int16_t del_l[GRANULAR_DELAY];
@@ -92,12 +100,12 @@ int16_t del_l[GRANULAR_DELAY];
 /**
  * Modulation
  */
-WavetableLFO square_lfo(500, TBL_SQUARE_LEN, TBL_SQUARE);
-WavetableLFO ramp_lfo(500, TBL_RAMP_LEN, TBL_RAMP);
-WavetableLFO wobble_lfo(500, TBL_WOBBLE_LEN, TBL_WOBBLE);
-WavetableLFO tri_lfo(500, TBL_TRI_LEN, TBL_TRI);
-WavetableLFO rev_wobble_lfo(500, TBL_REV_WOBBLE_LEN, TBL_REV_WOBBLE);
-WavetableLFO saw_lfo(500, TBL_SAW_LEN, TBL_SAW);
+WavetableLFO square_lfo(500, TBL_SQUARE);
+WavetableLFO ramp_lfo(500, TBL_RAMP);
+WavetableLFO wobble_lfo(500, TBL_WOBBLE);
+WavetableLFO tri_lfo(500, TBL_TRI);
+WavetableLFO rev_wobble_lfo(500, TBL_REV_WOBBLE);
+WavetableLFO saw_lfo(500, TBL_SAW);
 
 #define MATRIX_LFO_LEN 6
 WavetableLFO *MATRIX_LFO[MATRIX_LFO_LEN] = {
@@ -105,6 +113,52 @@ WavetableLFO *MATRIX_LFO[MATRIX_LFO_LEN] = {
 
 WavetableMatrixLFO matrix_lfo(500, MATRIX_LFO_LEN, MATRIX_LFO);
 
+// Renders the matrix LFO at audio rate, straight into the filter's
+// frequency control, and for the other effects once per block
+ModulationLFO mod_lfo(&matrix_lfo);
+AudioConnection patchCord19(mod_lfo, 0, vcf_l, 1);  // CUSTOM
+AudioConnection patchCord20(mod_lfo, 0, scrub_l, 1);  // CUSTOM
+AudioConnection patchCord21(mod_lfo, 0, cloud_l, 0);  // CUSTOM
+
+// User tables replace the built-in shapes in order, and the first preset
+// is applied at boot
+LFOBank lfo_bank;
+
+void apply_preset(const LFOPreset &preset) {
+    for (int h = 0; h < GRAIN_SCRUB_HEADS; h++) {
+        GrainHead *head = scrub_l.head(h);
+        head->setFadeShape((GrainWindowShape)preset.window);
+        head->setFadeMs(preset.fade_ms);
+        head->setInterpolation((GrainInterpolation)preset.interpolation);
+    }
+    mod_lfo.set_mode((LFOMode)preset.mode);
+}
+
+void load_lfo_bank(void) {
+    if (!SD.begin(BUILTIN_SDCARD) || !lfo_bank.begin("/lfo")) {
+        return;
+    }
+    for (int i = 0; i < lfo_bank.table_count() && i < MATRIX_LFO_LEN; i++) {
+        MATRIX_LFO[i]->set_table(lfo_bank.table(i));
+    }
+    if (lfo_bank.preset_count() > 0) {
+        apply_preset(lfo_bank.preset(0));
+    }
+    Serial.print("LFO bank: ");
+    Serial.print(lfo_bank.table_count());
+    Serial.print(" tables, ");
+    Serial.print(lfo_bank.preset_count());
+    Serial.print(" presets, ");
+    if (lfo_bank.from_cache) {
+        Serial.print("cache read in ");
+        Serial.print(lfo_bank.load_us);
+    } else {
+        Serial.print("parsed in ");
+        Serial.print(lfo_bank.parse_us);
+    }
+    Serial.println("us");
+}
+
 /**
  * FX
  */
@@ -113,10 +167,17 @@ bool mod_length = false;
 bool mod_speed = false;
 bool reset_on_trig = false;
 
-#define NUM_EFFECTS 5
+#define NUM_EFFECTS 6
 int fx[4] = {-1, -1, -1, -1};
 bool fx_enabled[NUM_EFFECTS];
-enum EffectType { LOWPASS, BANDPASS, AMPLITUDE_MODULATION, MIX, SAMPLE_RATE };
+enum EffectType {
+    LOWPASS,
+    BANDPASS,
+    AMPLITUDE_MODULATION,
+    MIX,
+    SAMPLE_RATE,
+    CLOUD
+};
 
 /**
  * Make auxilliary effects trigger randomly.
@@ -175,6 +236,11 @@ void enable_random_fx(int index) {
             mixers[2].gain(0, 0);
             mixers[2].gain(1, 0.95);
             break;
+        case EffectType::CLOUD:
+            Serial.println("Cloud ON");
+            cloud_l.setDensity(40.0);
+            mixers[0].gain(2, 0.5);
+            break;
     }
     fx[index] = effect;
 }
@@ -210,6 +276,11 @@ void disable_random_fx(int index) {
             mixers[2].gain(0, 0.95);
             mixers[2].gain(1, 0);
             break;
+        case EffectType::CLOUD:
+            Serial.println("Cloud OFF");
+            cloud_l.setDensity(0.0);
+            mixers[0].gain(2, 0);
+            break;
     }
     fx[index] = -1;
 }
@@ -222,8 +293,9 @@ unsigned long prev[8];
 
 void setup() {
     // If the "AudioMemoryUsageMax()" is reporting a number close or equal
-    // to what we have, just increase it.
-    AudioMemory(13);
+    // to what we have, just increase it. One block is for the cloud, which
+    // allocates its output while the scrub's is still held by the mixer.
+    AudioMemory(15);
 
     sgtl5000_1.enable();
     sgtl5000_1.inputSelect(AUDIO_INPUT_LINEIN);
@@ -234,14 +306,30 @@ void setup() {
     sine_l.amplitude(1);
     sine_l.frequency(220.0);
 
-    vcf_l.frequency(15000);
+    // The LFO sweeps the cutoff from 120Hz up to 7 octaves above
+    vcf_l.frequency(120);
+    vcf_l.octaveControl(7.0);
     vcf_l.resonance(2.5);
 
     bitcrusher_l.bits(16);
     bitcrusher_l.sampleRate(44100);
 
     scrub_l.begin(del_l, GRANULAR_DELAY);
-    scrub_l.setLengthPos(1.0);
+    for (int h = 0; h < GRAIN_SCRUB_HEADS; h++) {
+        GrainHead *head = scrub_l.head(h);
+        head->setLengthPos(1.0);
+        head->setFadeShape(GRAIN_WINDOW_HANN);
+        head->setFadeMs(3.0);
+        head->setInterpolation(GRAIN_INTERP_HERMITE);
+    }
+
+    load_lfo_bank();
+
+    cloud_l.begin(scrub_l.getRing());
+    cloud_l.setStartPos(0.5);
+    cloud_l.setLengthMs(60.0);
+    cloud_l.setDensity(0.0);
+    cloud_l.modulateJitter(0.5);
 
     mixers[0].gain(0, 0.95);
     mixers[0].gain(1, 0);
@@ -260,8 +348,7 @@ void setup() {
     mixers[3].gain(2, 0);
     mixers[3].gain(3, 0);
 
-    analogReadResolution(READ_RESOLUTION);
-    analogReadAveraging(READ_AVERAGE);
+    // The ADC is set up by the control scanner, see ANALOG_SCAN_RESOLUTION
     analogWriteResolution(WRITE_RESOLUTION);
 
     ctrl.register_button(0, PIN_MODE_BTN);
@@ -274,15 +361,149 @@ void setup() {
     ctrl.register_gtl(2, PIN_TRIG3, PIN_TRIG_LED3);
     ctrl.register_gtl(3, PIN_TRIG4, PIN_TRIG_LED4);
     ctrl.register_led(0, PIN_MODE_LED);
+    ctrl.register_cv(0, PIN_CV);
+    ctrl.register_clock(PIN_CLOCK);
+    ctrl.begin();
 
     fx_probabilities[EffectType::LOWPASS] = 66;
     fx_probabilities[EffectType::BANDPASS] = 40;
     fx_probabilities[EffectType::AMPLITUDE_MODULATION] = 25;
     fx_probabilities[EffectType::MIX] = 50;
     fx_probabilities[EffectType::SAMPLE_RATE] = 20;
+    fx_probabilities[EffectType::CLOUD] = 30;
+}
+
+/**
+ * Sets the length head back to one beat, or half the delay when there's no
+ * clock.
+ */
+void reset_length() {
+    ClockInput *clock = ctrl.get_clock();
+    if (clock->is_clocked) {
+        scrub_l.head(1)->setLengthMs(clock->clock_interval);
+    } else {
+        scrub_l.head(1)->setLengthPos(0.5);
+    }
+}
+
+/**
+ * Hands the gated heads over to the LFO, which the effect reads once per
+ * block. Once clocked, start positions land on the beat grid, and lengths
+ * and speeds on multiples and divisions of the beat.
+ */
+void modulate_heads() {
+    ClockInput *clock = ctrl.get_clock();
+    int32_t beat = 0;
+    if (clock->is_clocked) {
+        beat = clock->clock_interval * AUDIO_SAMPLE_RATE_EXACT * 0.001;
+    }
+    if (mod_start) {
+        scrub_l.head(0)->modulateStart(beat / CLOCK_GRID);
+    }
+    if (mod_length) {
+        scrub_l.head(1)->modulateLength(beat);
+    }
+    if (mod_speed) {
+        scrub_l.head(3)->modulateSpeed(clock->is_clocked);
+    }
+}
+
+/**
+ * Acts on new gate edges, as soon as they arrive rather than at the control
+ * rate.
+ */
+void handle_gates() {
+    GateTrigger *trig1 = ctrl.get_gtl(0);
+    GateTrigger *trig2 = ctrl.get_gtl(1);
+    GateTrigger *trig3 = ctrl.get_gtl(2);
+    GateTrigger *trig4 = ctrl.get_gtl(3);
+
+    bool start_freeze = false;
+    bool stop_freeze = false;
+
+    if (trig1->high) {
+        start_freeze = true;
+        mod_start = true;
+        scrub_l.head(0)->start();
+        enable_random_fx(0);
+    } else if (trig1->low) {
+        stop_freeze = true;
+        mod_start = false;
+        scrub_l.head(0)->stop();
+        scrub_l.head(0)->unmodulate();
+        scrub_l.head(0)->setStartPos(0.0);
+        disable_random_fx(0);
+    }
+
+    if (trig2->high) {
+        start_freeze = true;
+        mod_length = true;
+        scrub_l.head(1)->start();
+        enable_random_fx(1);
+    } else if (trig2->low) {
+        stop_freeze = true;
+        mod_length = false;
+        scrub_l.head(1)->stop();
+        scrub_l.head(1)->unmodulate();
+        reset_length();
+        disable_random_fx(1);
+    }
+
+    if (trig3->high) {
+        start_freeze = true;
+        scrub_l.head(2)->reverse();
+        scrub_l.head(2)->start();
+        enable_random_fx(2);
+    } else if (trig3->low) {
+        stop_freeze = true;
+        scrub_l.head(2)->stop();
+        scrub_l.head(2)->forward();
+        disable_random_fx(2);
+    }
+
+    if (trig4->high) {
+        start_freeze = true;
+        mod_speed = true;
+        scrub_l.head(3)->start();
+        enable_random_fx(3);
+    } else if (trig4->low) {
+        stop_freeze = true;
+        mod_speed = false;
+        scrub_l.head(3)->stop();
+        scrub_l.head(3)->unmodulate();
+        scrub_l.head(3)->setSpeed(1.0);
+        disable_random_fx(3);
+    }
+    
+    bool trig_on = trig1->gate || trig2->gate || trig3->gate || trig4->gate;
+
+    if (start_freeze) {
+        modulate_heads();
+        mixers[0].gain(0, 0);
+        mixers[0].gain(1, 0.95);
+        // The gate that started the freeze is already high, so trig_on is
+        // always set here
+        mod_lfo.trigger();
+    }
+
+    if (stop_freeze && !trig_on) {
+        mixers[0].gain(0, 0.95);
+        mixers[0].gain(1, 0);
+    }
 }
 
 void loop() {
+    // Only does anything when the delay lives in external storage
+    scrub_l.service();
+
+    if (ctrl.poll_gates()) {
+        handle_gates();
+    }
+    // Follow the tempo while the length isn't modulated
+    if (ctrl.get_clock()->beat && !mod_length) {
+        reset_length();
+    }
+
     if (ctrl.loop()) {
         cm = millis();
 
@@ -295,102 +516,29 @@ void loop() {
           ctrl_depth = 0.0;
         }
 
+        ClockInput *clock = ctrl.get_clock();
         matrix_lfo.set_shape(ctrl_waveshape);
-        matrix_lfo.set_time((int)ctrl_speed + 50);
-        lfo_mod = matrix_lfo.value;
+        mod_lfo.set_time((int)clock->quantize_ms(ctrl_speed + 50));
+        mod_lfo.offset(ctrl_offset);
+        mod_lfo.depth(ctrl_depth);
 
-        float mod = ctrl_offset + (lfo_mod - 0.5) * ctrl_depth;
-        mod = mod < 0.0 ? 0.0 : (mod > 1.0 ? 1.0 : mod);
+        // The filter, the heads and the cloud follow the LFO's blocks,
+        // everything else picks up its latest one
+        float mod = mod_lfo.read();
 
         crush_sample_rate = 2500 + 22500 * mod;
-        filter_frequency = 50 + 14950 * mod * mod;
         amp_mod_frequency = 1.0 + mod * 200.0;
 
         bitcrusher_l.sampleRate(crush_sample_rate);
-        vcf_l.frequency(filter_frequency);
         sine_l.frequency(amp_mod_frequency);
 
-        if (mod_start) {
-            scrub_l.setStartPos(mod);
-        }
-        if (mod_length) {
-            scrub_l.setLengthPos(mod);
-        }
-        if (mod_speed) {
-            scrub_l.setSpeed(pow(2.0, (mod - 0.5) * 6.0));
-        }
+        // Follows the tempo and the clock locking or dropping out
+        modulate_heads();
 
         Button *btn = ctrl.get_button(0);
-        GateTrigger *trig1 = ctrl.get_gtl(0);
-        GateTrigger *trig2 = ctrl.get_gtl(1);
-        GateTrigger *trig3 = ctrl.get_gtl(2);
-        GateTrigger *trig4 = ctrl.get_gtl(3);
-
         if (btn->long_click) {
             reset_on_trig = !reset_on_trig;
-        }
-
-        bool start_freeze = false;
-        bool stop_freeze = false;
-
-        if (trig1->high) {
-            start_freeze = true;
-            mod_start = true;
-            enable_random_fx(0);
-        } else if (trig1->low) {
-            stop_freeze = true;
-            mod_start = false;
-            scrub_l.setStartPos(0.0);
-            disable_random_fx(0);
-        }
-
-        if (trig2->high) {
-            start_freeze = true;
-            mod_length = true;
-            enable_random_fx(1);
-        } else if (trig2->low) {
-            stop_freeze = true;
-            mod_length = false;
-            scrub_l.setLengthPos(0.5);
-            disable_random_fx(1);
-        }
-
-        if (trig3->high) {
-            start_freeze = true;
-            scrub_l.reverse();
-            enable_random_fx(2);
-        } else if (trig3->low) {
-            stop_freeze = true;
-            scrub_l.forward();
-            disable_random_fx(2);
-        }
-
-        if (trig4->high) {
-            start_freeze = true;
-            mod_speed = true;
-            enable_random_fx(3);
-        } else if (trig4->low) {
-            stop_freeze = true;
-            mod_speed = false;
-            scrub_l.setSpeed(1.0);
-            disable_random_fx(3);
-        }
-        
-        bool trig_on = trig1->gate || trig2->gate || trig3->gate || trig4->gate;
-
-        if (start_freeze) {
-            scrub_l.start();
-            mixers[0].gain(0, 0);
-            mixers[0].gain(1, 0.95);
-            if (reset_on_trig && !trig_on) {
-                matrix_lfo.reset();
-            }
-        }
-
-        if (stop_freeze && !trig_on) {
-            scrub_l.stop();
-            mixers[0].gain(0, 0.95);
-            mixers[0].gain(1, 0);
+            mod_lfo.set_mode(reset_on_trig ? LFO_RETRIGGER : LFO_FREE);
         }
 
         bool mix_enabled = fx_enabled[EffectType::MIX];
@@ -398,8 +546,7 @@ void loop() {
             mixers[0].gain(1, mod);
         }
 
-        matrix_lfo.loop(cm);
-        // scrub_l.debug();
+        // scrub_l.head(0)->debug();
 
         if (cm - prev[0] > 500) {
             prev[0] = cm;
@@ -0,0 +1,56 @@
+#include "ring.h"
+
+void GrainRing::begin(int16_t *bank_def, int32_t max_len_def) {
+    memory = GrainMemoryStorage(bank_def, max_len_def);
+    begin(&memory);
+}
+
+void GrainRing::begin(GrainStorage *storage_def) {
+    storage = storage_def;
+    size = 1;
+    while (size <= storage->length() / 2) {
+        size <<= 1;
+    }
+    mask = size - 1;
+    write_head = 0;
+    overruns = 0;
+    queue_head = 0;
+    queue_tail = 0;
+    bank = storage->map();
+}
+
+bool GrainRing::record(const int16_t *in, int n) {
+    if (bank != NULL) {
+        int first = min(n, size - write_head);
+        memcpy(bank + write_head, in, first * sizeof(int16_t));
+        if (first < n) {
+            memcpy(bank, in + first, (n - first) * sizeof(int16_t));
+        }
+    } else if (!storage->writable()) {
+        return false;
+    } else if ((uint8_t)(queue_head - queue_tail) < GRAIN_WRITE_BLOCKS) {
+        QueuedBlock &block = queue[queue_head % GRAIN_WRITE_BLOCKS];
+        block.index = write_head;
+        block.n = n;
+        memcpy(block.data, in, n * sizeof(int16_t));
+        queue_head = queue_head + 1;
+    } else {
+        // The storage keeps whatever was there before, but the write head
+        // still moves on so the ring stays in time with the audio
+        overruns++;
+    }
+    write_head = (write_head + n) & mask;
+    return true;
+}
+
+void GrainRing::flush(void) {
+    while (queue_tail != queue_head) {
+        QueuedBlock &block = queue[queue_tail % GRAIN_WRITE_BLOCKS];
+        int first = min(block.n, size - block.index);
+        storage->write(block.index, block.data, first);
+        if (first < block.n) {
+            storage->write(0, block.data + first, block.n - first);
+        }
+        queue_tail = queue_tail + 1;
+    }
+}
@@ -0,0 +1,96 @@
+// ring.h
+
+#include <Arduino.h>
+#include <Audio.h>
+
+#include "storage.h"
+
+#pragma once
+
+#ifndef M_RING_H_
+#define M_RING_H_
+
+/**
+ * Number of blocks the writer can queue for storage that isn't mapped
+ * before it has to drop them. A power of two no larger than 128.
+ */
+#define GRAIN_WRITE_BLOCKS 8
+
+/**
+ * Capture ring shared by the grain engines. A single writer records into it
+ * and any number of grain readers play out of it.
+ *
+ * The ring is rounded down to a power of two so readers can wrap with a mask
+ * instead of a modulo. The sample at write_head is always the oldest in the
+ * ring.
+ *
+ * The audio lives in a GrainStorage. When the storage is mapped, the writer
+ * copies straight into it and bank points at it. Otherwise bank is NULL, the
+ * writer queues blocks for flush() to write from loop(), and readers go
+ * through a GrainCache.
+ */
+class GrainRing {
+   public:
+    GrainRing(void)
+        : bank(NULL),
+          size(0),
+          mask(0),
+          write_head(0),
+          overruns(0),
+          storage(NULL),
+          queue_head(0),
+          queue_tail(0) {}
+
+    /**
+     * @param bank_def Audio buffer array of int16_t
+     * @param max_len_def Length of bank_def
+     */
+    void begin(int16_t *bank_def, int32_t max_len_def);
+
+    /**
+     * @param storage_def Storage for the ring, which is rounded down to a
+     *                    power of two
+     */
+    void begin(GrainStorage *storage_def);
+
+    /**
+     * Writes samples to the ring at the write head, with at most two copies
+     * split where the block wraps. n must not be larger than the ring, or
+     * than one audio block if the storage isn't mapped.
+     *
+     * @return Whether the samples were recorded, which they never are for
+     *         storage that can't be written
+     */
+    bool record(const int16_t *in, int n);
+
+    /**
+     * Writes the blocks queued by record() to storage that isn't mapped.
+     * Call it from loop().
+     */
+    void flush(void);
+
+    GrainStorage *getStorage(void) { return storage; }
+
+    int16_t *bank;
+    int32_t size;
+    int32_t mask;
+    int32_t write_head;
+
+    // Blocks dropped because flush() didn't keep up
+    uint32_t overruns;
+
+   private:
+    struct QueuedBlock {
+        int32_t index;
+        int n;
+        int16_t data[AUDIO_BLOCK_SAMPLES];
+    };
+
+    GrainStorage *storage;
+    GrainMemoryStorage memory;
+    QueuedBlock queue[GRAIN_WRITE_BLOCKS];
+    volatile uint8_t queue_head;
+    volatile uint8_t queue_tail;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "scanner.h"
+
+#ifdef TEENSYDUINO
+#include <ADC.h>
+#include <IntervalTimer.h>
+
+static ADC adc;
+static IntervalTimer timer;
+static AnalogScanner* active = NULL;
+
+static void scan_timer_isr(void) { active->tick(); }
+
+static void scan_adc_isr(void) { active->complete(adc.adc0->readSingle()); }
+#endif
+
+AnalogScanner::AnalogScanner(void) {
+    _count = 0;
+    _fast_turn = false;
+    _pending = -1;
+    _source = NULL;
+    for (int i = 0; i < 2; i++) {
+        _sizes[i] = 0;
+        _cursors[i] = 0;
+    }
+}
+
+int AnalogScanner::add(int pin, bool fast) {
+    if (_count >= ANALOG_SCAN_CHANNELS) {
+        return -1;
+    }
+    int channel = _count++;
+    Channel& ch = _channels[channel];
+    ch.pin = pin;
+    ch.fast = fast;
+    ch.count = 0;
+    for (int i = 0; i < ANALOG_SCAN_HISTORY; i++) {
+        ch.history[i] = 0;
+    }
+    _order[fast][_sizes[fast]++] = channel;
+    return channel;
+}
+
+void AnalogScanner::begin(uint32_t rate) {
+#ifdef TEENSYDUINO
+    if (_source != NULL || _count == 0) {
+        return;
+    }
+    active = this;
+    adc.adc0->setResolution(ANALOG_SCAN_RESOLUTION);
+    adc.adc0->setAveraging(ANALOG_SCAN_AVERAGING);
+    adc.adc0->enableInterrupts(scan_adc_isr);
+    timer.begin(scan_timer_isr, 1000000.0f / rate);
+#else
+    (void)rate;
+#endif
+}
+
+int AnalogScanner::read(int channel, int* out, int n) {
+    Channel& ch = _channels[channel];
+    uint32_t count = ch.count;
+    if ((uint32_t)n > count) {
+        n = count;
+    }
+    if (n > ANALOG_SCAN_HISTORY) {
+        n = ANALOG_SCAN_HISTORY;
+    }
+    for (int i = 0; i < n; i++) {
+        out[i] = ch.history[(count - n + i) & (ANALOG_SCAN_HISTORY - 1)];
+    }
+    return n;
+}
+
+int AnalogScanner::next(void) {
+    // Fast channels take every other turn, or every turn if they're all
+    // there is
+    bool fast = _sizes[1] > 0 && (_fast_turn || _sizes[0] == 0);
+    _fast_turn = !_fast_turn;
+    int& cursor = _cursors[fast];
+    int channel = _order[fast][cursor];
+    if (++cursor >= _sizes[fast]) {
+        cursor = 0;
+    }
+    return channel;
+}
+
+void AnalogScanner::tick(void) {
+    // Still converting, so skip a turn rather than wait
+    if (_count == 0 || _pending >= 0) {
+        return;
+    }
+    int channel = next();
+    _pending = channel;
+    if (_source != NULL) {
+        complete(_source(_channels[channel].pin));
+        return;
+    }
+#ifdef TEENSYDUINO
+    if (!adc.adc0->startSingleRead(_channels[channel].pin)) {
+        _pending = -1;
+    }
+#else
+    _pending = -1;
+#endif
+}
+
+void AnalogScanner::complete(int value) {
+    int channel = _pending;
+    if (channel < 0) {
+        return;
+    }
+    Channel& ch = _channels[channel];
+    // The reading goes in before the count moves on, so readers never see
+    // a slot that hasn't been written
+    ch.history[ch.count & (ANALOG_SCAN_HISTORY - 1)] = value;
+    ch.count = ch.count + 1;
+    _pending = -1;
+}
@@ -0,0 +1,133 @@
+// scanner.h
+
+#include <Arduino.h>
+
+#pragma once
+
+#ifndef M_SCANNER_H_
+#define M_SCANNER_H_
+
+/**
+ * Most analog inputs one scanner can cycle through.
+ */
+#define ANALOG_SCAN_CHANNELS 8
+
+/**
+ * Readings kept per channel. A power of two.
+ */
+#define ANALOG_SCAN_HISTORY 16
+
+/**
+ * Conversions started per second, shared between all channels. Half go to
+ * fast channels when there are any.
+ */
+#define ANALOG_SCAN_RATE 8000
+
+/**
+ * ADC settings for every analog input in the sketch. begin() applies them,
+ * so nothing else should set the resolution or averaging.
+ */
+#define ANALOG_SCAN_RESOLUTION 12
+#define ANALOG_SCAN_AVERAGING 8
+
+/**
+ * Reads analog inputs in the background, so nothing in loop() waits on a
+ * conversion.
+ *
+ * A timer interrupt starts one conversion at a time, cycling through the
+ * channels, and the ADC's conversion-complete interrupt stores each result
+ * in its channel's ring of recent readings. Readers only ever look at the
+ * rings, so reading a channel never blocks and costs the same however many
+ * channels there are.
+ *
+ * Channels added as fast, such as CV inputs, take every other conversion
+ * between them, so each is read far more often than the pots.
+ *
+ * Off the Teensy, or whenever set_source() has been given a function, there
+ * is no hardware involved: tick() reads the source straight away, and
+ * something else has to call tick(). That's how it's run on a host.
+ */
+class AnalogScanner {
+   public:
+    AnalogScanner(void);
+
+    /**
+     * @param pin Analog pin to read
+     * @param fast Whether to read it every other conversion
+     * @return Channel number, or -1 if there's no room
+     */
+    int add(int pin, bool fast = false);
+
+    /**
+     * Starts scanning in the background. Add every channel first.
+     *
+     * @param rate Conversions per second across all channels
+     */
+    void begin(uint32_t rate = ANALOG_SCAN_RATE);
+
+    /**
+     * Replaces the ADC with a function, for running without hardware.
+     */
+    void set_source(int (*source)(int pin)) { _source = source; }
+
+    /**
+     * @return The latest reading of a channel, or 0 before the first
+     */
+    int latest(int channel) {
+        Channel& ch = _channels[channel];
+        uint32_t count = ch.count;
+        return count == 0 ? 0
+                          : ch.history[(count - 1) & (ANALOG_SCAN_HISTORY - 1)];
+    }
+
+    /**
+     * Copies up to n of the most recent readings of a channel into out,
+     * oldest first.
+     *
+     * @return Number of readings copied
+     */
+    int read(int channel, int* out, int n);
+
+    /**
+     * @return Number of readings a channel has taken so far
+     */
+    uint32_t count(int channel) { return _channels[channel].count; }
+
+    /**
+     * Starts the next conversion. Called by the timer interrupt.
+     */
+    void tick(void);
+
+    /**
+     * Stores the result of the conversion in progress. Called by the ADC
+     * interrupt.
+     */
+    void complete(int value);
+
+   private:
+    struct Channel {
+        int pin;
+        bool fast;
+        volatile uint32_t count;
+        volatile int16_t history[ANALOG_SCAN_HISTORY];
+    };
+
+    /**
+     * Picks the channel for the next conversion.
+     */
+    int next(void);
+
+    Channel _channels[ANALOG_SCAN_CHANNELS];
+    int _count;
+    // Slow channels, then fast ones, each with a cursor, and whether the
+    // next conversion goes to a fast one
+    uint8_t _order[2][ANALOG_SCAN_CHANNELS];
+    int _sizes[2];
+    int _cursors[2];
+    bool _fast_turn;
+    // Channel being converted, or -1
+    volatile int _pending;
+    int (*_source)(int pin);
+};
+
+#endif
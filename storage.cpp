@@ -0,0 +1,77 @@
+#include "storage.h"
+
+// Samples copied at a time by GrainFlashStorage::save()
+#define SAVE_CHUNK 256
+
+bool GrainMemoryStorage::read(int32_t index, int16_t *out, int n) {
+    if (bank == NULL || index < 0 || index + n > len) {
+        return false;
+    }
+    memcpy(out, bank + index, n * sizeof(int16_t));
+    return true;
+}
+
+bool GrainMemoryStorage::write(int32_t index, const int16_t *in, int n) {
+    if (bank == NULL || index < 0 || index + n > len) {
+        return false;
+    }
+    memcpy(bank + index, in, n * sizeof(int16_t));
+    return true;
+}
+
+bool GrainFlashStorage::begin(const char *name) {
+    file = SerialFlash.open(name);
+    if (!file) {
+        len = 0;
+        return false;
+    }
+    len = file.size() / sizeof(int16_t);
+    return true;
+}
+
+bool GrainFlashStorage::save(const char *name, GrainStorage *storage,
+                             int32_t from, int32_t n) {
+    int16_t chunk[SAVE_CHUNK];
+    int32_t size = storage->length();
+
+    file.close();
+    len = 0;
+    if (!SerialFlash.exists(name) &&
+        !SerialFlash.createErasable(name, n * sizeof(int16_t))) {
+        return false;
+    }
+    file = SerialFlash.open(name);
+    if (!file) {
+        return false;
+    }
+    file.erase();
+    for (int32_t i = 0; i < n; i += SAVE_CHUNK) {
+        int count = min((int32_t)SAVE_CHUNK, n - i);
+        int32_t index = (from + i) % size;
+        // Split the chunk where it wraps around the end of the source
+        int first = min((int32_t)count, size - index);
+        if (!storage->read(index, chunk, first)) {
+            return false;
+        }
+        if (first < count &&
+            !storage->read(0, chunk + first, count - first)) {
+            return false;
+        }
+        file.write(chunk, count * sizeof(int16_t));
+    }
+    len = n;
+    return true;
+}
+
+bool GrainFlashStorage::read(int32_t index, int16_t *out, int n) {
+    if (!file || index < 0 || index + n > len) {
+        return false;
+    }
+    file.seek(index * sizeof(int16_t));
+    return file.read(out, n * sizeof(int16_t)) == n * sizeof(int16_t);
+}
+
+bool GrainFlashStorage::write(int32_t, const int16_t *, int) {
+    // Saved loops are only ever written whole, by save()
+    return false;
+}
@@ -0,0 +1,122 @@
+// storage.h
+
+#include <Arduino.h>
+#include <SerialFlash.h>
+
+#pragma once
+
+#ifndef M_STORAGE_H_
+#define M_STORAGE_H_
+
+/**
+ * Where a GrainRing keeps its audio. Storage that the CPU can read as plain
+ * memory at full speed is mapped, and the kernels read it directly. Anything
+ * slower is only ever read and written from loop(), through a GrainCache
+ * for each read head and the ring's write queue, so the audio interrupt
+ * never waits on it.
+ */
+class GrainStorage {
+   public:
+    virtual ~GrainStorage(void) {}
+
+    /**
+     * @return Number of samples the storage holds
+     */
+    virtual int32_t length(void) = 0;
+
+    /**
+     * Copies n samples starting at index into out. Only called from loop()
+     * for storage that isn't mapped.
+     */
+    virtual bool read(int32_t index, int16_t *out, int n) = 0;
+
+    /**
+     * Copies n samples from in to the storage starting at index.
+     */
+    virtual bool write(int32_t index, const int16_t *in, int n) = 0;
+
+    /**
+     * @return Pointer the kernels can read directly, or NULL if reads must go
+     *         through a GrainCache
+     */
+    virtual int16_t *map(void) { return NULL; }
+
+    /**
+     * @return Whether the ring may keep recording into the storage
+     */
+    virtual bool writable(void) { return true; }
+};
+
+/**
+ * On-chip RAM, the default behind GrainScrubEffectCircular::begin().
+ */
+class GrainMemoryStorage : public GrainStorage {
+   public:
+    GrainMemoryStorage(void) : bank(NULL), len(0) {}
+    GrainMemoryStorage(int16_t *bank_def, int32_t len_def)
+        : bank(bank_def), len(len_def) {}
+
+    virtual int32_t length(void) { return len; }
+    virtual bool read(int32_t index, int16_t *out, int n);
+    virtual bool write(int32_t index, const int16_t *in, int n);
+    virtual int16_t *map(void) { return bank; }
+
+   protected:
+    int16_t *bank;
+    int32_t len;
+};
+
+/**
+ * External PSRAM, such as an EXTMEM array on a Teensy 4.1. It's memory
+ * mapped, but a read that misses the CPU's data cache stalls on the FlexSPI
+ * bus, so it's treated like any other slow storage and staged through a
+ * GrainCache rather than read from the audio interrupt.
+ */
+class GrainExternalStorage : public GrainMemoryStorage {
+   public:
+    GrainExternalStorage(int16_t *bank_def, int32_t len_def)
+        : GrainMemoryStorage(bank_def, len_def) {}
+
+    virtual int16_t *map(void) { return NULL; }
+};
+
+/**
+ * A file on a SerialFlash chip, for playing back frozen loops saved with
+ * save(). Flash can only be written once between erases, so the ring never
+ * records into it.
+ */
+class GrainFlashStorage : public GrainStorage {
+   public:
+    GrainFlashStorage(void) : len(0) {}
+
+    /**
+     * Opens a loop saved earlier.
+     *
+     * @return Whether the file exists
+     */
+    bool begin(const char *name);
+
+    /**
+     * Erases a file and saves a loop to it, oldest sample first. This
+     * blocks until the erase and every write has finished, so call it from
+     * loop() and only while nothing is playing from the file.
+     *
+     * @param name File name on the flash chip
+     * @param storage Storage to copy from, read from its oldest sample on
+     * @param from Index of the oldest sample in storage
+     * @param n Number of samples to save
+     */
+    bool save(const char *name, GrainStorage *storage, int32_t from,
+              int32_t n);
+
+    virtual int32_t length(void) { return len; }
+    virtual bool read(int32_t index, int16_t *out, int n);
+    virtual bool write(int32_t index, const int16_t *in, int n);
+    virtual bool writable(void) { return false; }
+
+   private:
+    SerialFlashFile file;
+    int32_t len;
+};
+
+#endif
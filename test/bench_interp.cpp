@@ -0,0 +1,91 @@
+// Times the interpolators in interp.h per output sample, reading a grain at
+// 1.3x through a 16.16 accumulator as the kernels do, and measures their
+// error against the same curves worked out in double precision.
+
+#include <math.h>
+
+#include <chrono>
+#include <random>
+
+#include "interp.h"
+
+#define SAMPLES 8192
+#define READS 2000000
+#define RATE 85197
+
+static int16_t samples[SAMPLES + 4];
+static volatile int32_t sink;
+
+static double linear(double x0, double x1, double t) {
+    return x0 + (x1 - x0) * t;
+}
+
+static double hermite(double xm1, double x0, double x1, double x2, double t) {
+    double c1 = 0.5 * (x1 - xm1);
+    double c2 = xm1 - 2.5 * x0 + 2 * x1 - 0.5 * x2;
+    double c3 = 0.5 * (x2 - xm1) + 1.5 * (x0 - x1);
+    double out = ((c3 * t + c2) * t + c1) * t + x0;
+    return fmin(fmax(out, -32768), 32767);
+}
+
+template <GrainInterpolation I>
+static int32_t read(uint32_t acc) {
+    const int16_t *x = samples + 1 + ((acc >> 16) & (SAMPLES - 1));
+    if (I == GRAIN_INTERP_LINEAR) {
+        return grain_interpolate_linear(x[0], x[1], acc);
+    } else if (I == GRAIN_INTERP_HERMITE) {
+        return grain_interpolate_hermite(x[-1], x[0], x[1], x[2], acc);
+    }
+    return x[0];
+}
+
+template <GrainInterpolation I>
+static double ns_per_read(void) {
+    uint32_t acc = 0;
+    int32_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < READS; i++) {
+        sum += read<I>(acc);
+        acc += RATE;
+    }
+    std::chrono::duration<double, std::nano> took =
+        std::chrono::steady_clock::now() - start;
+    sink = sum;
+    return took.count() / READS;
+}
+
+/**
+ * @return Worst difference from the double precision curve, in LSB
+ */
+template <GrainInterpolation I>
+static double worst_error(void) {
+    double worst = 0.0;
+    uint32_t acc = 0;
+    for (int i = 0; i < READS; i++) {
+        const int16_t *x = samples + 1 + ((acc >> 16) & (SAMPLES - 1));
+        double t = (acc & 0xFFFF) / 65536.0;
+        double exact = I == GRAIN_INTERP_LINEAR
+                           ? linear(x[0], x[1], t)
+                           : hermite(x[-1], x[0], x[1], x[2], t);
+        worst = fmax(worst, fabs(read<I>(acc) - exact));
+        acc += RATE;
+    }
+    return worst;
+}
+
+int main(void) {
+    std::mt19937 rng(1);
+    for (int i = 0; i < SAMPLES + 4; i++) {
+        samples[i] = (int16_t)rng();
+    }
+
+    double none = ns_per_read<GRAIN_INTERP_NONE>();
+    printf("none:    %5.2f ns/sample\n", none);
+    printf("linear:  %5.2f ns/sample, worst error %5.2f LSB\n",
+           ns_per_read<GRAIN_INTERP_LINEAR>(),
+           worst_error<GRAIN_INTERP_LINEAR>());
+    printf("hermite: %5.2f ns/sample, worst error %5.2f LSB\n",
+           ns_per_read<GRAIN_INTERP_HERMITE>(),
+           worst_error<GRAIN_INTERP_HERMITE>());
+    return 0;
+}
@@ -0,0 +1,157 @@
+// Times the pot smoothing per tick at window sizes from 32 to 256, kept
+// sorted in place as Potentiometer does, against the bubble sort it
+// replaced.
+//
+// Potentiometer's window is fixed by POT_SMOOTH_SAMPLES, so SortedPot
+// repeats its replace() with the size as a template parameter. Both are
+// checked against each other before they're timed, and SortedPot<32>
+// against Potentiometer itself.
+
+#include <chrono>
+#include <random>
+
+#include "control.h"
+#include "pot_reference.h"
+
+#define TICKS 20000
+
+template <int N>
+class SortedPot {
+   public:
+    SortedPot(void) : smooth(0), band_total(0) {
+        for (int i = 0; i < N; i++) {
+            samples[i] = 0;
+            sorted[i] = 0;
+        }
+    }
+
+    int loop(int curr) {
+        smooth = (smooth + 1) % N;
+        int old_value = samples[smooth];
+        samples[smooth] = curr;
+        replace(old_value, curr);
+        int value = map(band_total / (TOP - BOTTOM), 50, 4000, 0, 4095);
+        return value < 0 ? 0 : (value > 4095 ? 4095 : value);
+    }
+
+   private:
+    static const int BOTTOM = (N * 20) / 100 > 1 ? (N * 20) / 100 : 1;
+    static const int TOP = (N * 80) / 100 + 1 < N - 1 ? (N * 80) / 100 + 1
+                                                      : N - 1;
+
+    static bool in_band(int index) { return index >= BOTTOM && index < TOP; }
+
+    void replace(int old_value, int new_value) {
+        int lo = 0;
+        int hi = N - 1;
+        while (lo < hi) {
+            int mid = (lo + hi) >> 1;
+            if (sorted[mid] < old_value) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        int j = lo;
+        if (in_band(j)) {
+            band_total -= old_value;
+        }
+        if (new_value > old_value) {
+            while (j + 1 < N && sorted[j + 1] < new_value) {
+                int moved = sorted[j + 1];
+                sorted[j] = moved;
+                band_total += (in_band(j) - in_band(j + 1)) * (long)moved;
+                j++;
+            }
+        } else {
+            while (j > 0 && sorted[j - 1] > new_value) {
+                int moved = sorted[j - 1];
+                sorted[j] = moved;
+                band_total += (in_band(j) - in_band(j - 1)) * (long)moved;
+                j--;
+            }
+        }
+        sorted[j] = new_value;
+        if (in_band(j)) {
+            band_total += new_value;
+        }
+    }
+
+    int samples[N];
+    int sorted[N];
+    int smooth;
+    long band_total;
+};
+
+static int readings[TICKS];
+static volatile int sink;
+
+// A pot being turned slowly, with ADC noise
+static void make_readings(void) {
+    std::mt19937 rng(1);
+    for (int t = 0; t < TICKS; t++) {
+        readings[t] = 2000 + 1500 * sin(t * 0.001) + rng() % 40;
+    }
+}
+
+template <class Pot>
+static double ns_per_tick(void) {
+    Pot pot;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < TICKS; t++) {
+        sink = pot.loop(readings[t]);
+    }
+    std::chrono::duration<double, std::nano> took =
+        std::chrono::steady_clock::now() - start;
+    return took.count() / TICKS;
+}
+
+template <int N>
+static bool agree(void) {
+    SortedPot<N> sorted;
+    BubblePot<N> bubble;
+    for (int t = 0; t < TICKS; t++) {
+        if (sorted.loop(readings[t]) != bubble.loop(readings[t])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <int N>
+static void bench(void) {
+    bool same = agree<N>();
+    double bubble = ns_per_tick<BubblePot<N> >();
+    double sorted = ns_per_tick<SortedPot<N> >();
+    printf("%4d readings: bubble sort %9.1f ns, sorted %6.1f ns, %6.1fx%s\n",
+           N, bubble, sorted, bubble / sorted, same ? "" : "  DISAGREE");
+}
+
+static int reading = 0;
+
+static int source(int) { return reading; }
+
+int main(void) {
+    make_readings();
+
+    AnalogScanner scanner;
+    scanner.set_source(source);
+    Potentiometer pot(0);
+    pot.attach(&scanner, scanner.add(0));
+    SortedPot<POT_SMOOTH_SAMPLES> copy;
+    long wrong = 0;
+    for (int t = 0; t < TICKS; t++) {
+        reading = readings[t];
+        scanner.tick();
+        pot.loop(0);
+        wrong += pot.value != copy.loop(reading);
+    }
+    printf("SortedPot<%d> vs Potentiometer: %ld of %d ticks differ\n",
+           POT_SMOOTH_SAMPLES, wrong, TICKS);
+
+    bench<32>();
+    bench<64>();
+    bench<128>();
+    bench<256>();
+    return 0;
+}
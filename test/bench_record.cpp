@@ -0,0 +1,94 @@
+// Times the idle recorder: GrainRing::record() writing each block with at
+// most two copies, against the per-sample loop it replaced, which stored
+// every sample in both halves of a ping-pong buffer and wrapped the write
+// head with a mask.
+//
+// The ring starts a few samples off a block boundary so blocks keep
+// straddling the wrap. The ring record() leaves behind is checked against
+// the loop's before they're timed.
+
+#include <chrono>
+
+#include "ring.h"
+
+#define BLOCKS 200000
+#define RING 16384
+#define SKEW 37
+
+class PerSampleRecorder {
+   public:
+    PerSampleRecorder(int16_t *bank_def, int32_t max_len_def)
+        : bank(bank_def), half(max_len_def / 2), mask(half - 1),
+          write_head(SKEW) {}
+
+    void record(const int16_t *in) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            bank[write_head] = in[i];
+            bank[write_head + half] = in[i];
+            write_head = (write_head + 1) & mask;
+        }
+    }
+
+    int16_t *bank;
+    int32_t half;
+    int32_t mask;
+    int32_t write_head;
+};
+
+static int16_t bank_a[RING];
+static int16_t bank_b[RING];
+static int16_t input[64][AUDIO_BLOCK_SAMPLES];
+
+static void make_input(void) {
+    uint32_t seed = 1;
+    for (int b = 0; b < 64; b++) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            seed = seed * 1664525 + 1013904223;
+            input[b][i] = seed >> 16;
+        }
+    }
+}
+
+static const int16_t *block(int b) { return input[b & 63]; }
+
+static double since(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double, std::nano> took =
+        std::chrono::steady_clock::now() - start;
+    return took.count() / BLOCKS;
+}
+
+int main(void) {
+    make_input();
+
+    PerSampleRecorder loop(bank_a, RING);
+    GrainRing ring;
+    // Half as long, as the loop records each sample twice
+    ring.begin(bank_b, RING / 2);
+    ring.write_head = SKEW;
+    for (int b = 0; b < 1000; b++) {
+        loop.record(block(b));
+        ring.record(block(b), AUDIO_BLOCK_SAMPLES);
+    }
+    long wrong = loop.write_head != ring.write_head;
+    for (int32_t i = 0; i < ring.size; i++) {
+        wrong += bank_a[i] != ring.bank[i];
+    }
+    printf("record() vs per-sample loop: %ld samples differ\n", wrong);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int b = 0; b < BLOCKS; b++) {
+        loop.record(block(b));
+    }
+    double per_sample = since(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int b = 0; b < BLOCKS; b++) {
+        ring.record(block(b), AUDIO_BLOCK_SAMPLES);
+    }
+    double copies = since(start);
+
+    printf("idle recorder: per-sample %6.1f ns/block, record() %6.1f "
+           "ns/block, %4.1fx\n",
+           per_sample, copies, per_sample / copies);
+    return 0;
+}
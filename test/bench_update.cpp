@@ -0,0 +1,201 @@
+// Times GrainScrubEffectCircular::update() per block against the node it
+// replaced, and splits the new node's time into its parts.
+//
+// The old node is built from baseline/, which is circular.h and
+// circular.cpp as they were before any of the grain work, unchanged. It
+// wraps its ping-pong halves with a modulo against a length only known at
+// run time, which costs a divide per sample. This used to be compared with
+// a hand-written copy of its loop wrapped by a mask instead. That copy had
+// none of a node's per-block work, so it looked faster than the new node
+// did, 360 against 481 ns/block.
+//
+// Both nodes here play one 1.0x grain and record every block, and both go
+// through the stub's receive, transmit and release. The new node's time is
+// split into:
+// - record(), the ring's two copies of the block.
+// - The playback kernel over the same grain, run out of line.
+// - Per-block work it also does idle: receiving and sending the block, and
+//   picking up start() and stop(), events and modulation for four heads.
+// - Per-block work only done while playing: setting up each head's grain,
+//   mixing into a 32-bit sum and clamping it, and publishing the head's
+//   position for prefetch().
+
+#include <chrono>
+
+#include "circular.h"
+
+namespace baseline {
+#include "baseline/circular.cpp"
+}
+
+#define BLOCKS 50000
+#define RING 16384
+// Each time is the best of this many runs, as the host is noisy
+#define RUNS 9
+
+static int16_t bank[20000];
+static int16_t input[64][AUDIO_BLOCK_SAMPLES];
+static int16_t output[AUDIO_BLOCK_SAMPLES];
+static volatile int16_t sink;
+
+static void make_input(void) {
+    uint32_t seed = 1;
+    for (int b = 0; b < 64; b++) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            seed = seed * 1664525 + 1013904223;
+            input[b][i] = seed >> 16;
+        }
+    }
+}
+
+static const int16_t *block(int b) { return input[b & 63]; }
+
+static double since(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double, std::nano> took =
+        std::chrono::steady_clock::now() - start;
+    return took.count() / BLOCKS;
+}
+
+/**
+ * Runs a node for BLOCKS blocks.
+ *
+ * @return ns per block
+ */
+template <class Node>
+static double run(Node &fx) {
+    double best = 1e9;
+    for (int r = 0; r < RUNS; r++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int b = 0; b < BLOCKS; b++) {
+            memcpy(fx.input.data, block(b), sizeof(fx.input.data));
+            fx.has_input = true;
+            fx.update();
+            sink = fx.output.data[b & (AUDIO_BLOCK_SAMPLES - 1)];
+        }
+        best = min(best, since(start));
+    }
+    return best;
+}
+
+static void bench_baseline(int16_t len) {
+    static baseline::GrainScrubEffectCircular fx;
+    fx.begin(bank, len);
+    fx.setStartPos(0.2);
+    fx.setLengthPos(0.6);
+    fx.setSpeed(1.0);
+    for (int b = 0; b < 200; b++) {
+        memcpy(fx.input.data, block(b), sizeof(fx.input.data));
+        fx.has_input = true;
+        fx.update();
+    }
+    double idle = run(fx);
+    fx.start();
+    double running = run(fx);
+    printf("old node, %5d samples        running %7.1f ns/block, idle %7.1f "
+           "ns/block\n",
+           len, running, idle);
+}
+
+/**
+ * @return ns per block of the whole node playing one grain
+ */
+static double bench_effect(double *idle_out) {
+    static GrainScrubEffectCircular fx;
+    fx.begin(bank, RING);
+    GrainHead *head = fx.head(0);
+    head->setStartPos(0.2);
+    head->setLengthPos(0.6);
+    head->setSpeed(1.0);
+    for (int b = 0; b < 200; b++) {
+        memcpy(fx.input.data, block(b), sizeof(fx.input.data));
+        fx.has_input = true;
+        fx.update();
+    }
+    double idle = run(fx);
+    head->start();
+    double running = run(fx);
+    *idle_out = idle;
+    printf("GrainScrubEffectCircular, %5d running %7.1f ns/block, idle %7.1f "
+           "ns/block\n",
+           RING, running, idle);
+    return running;
+}
+
+/**
+ * @return ns per block of GrainRing::record()
+ */
+static double bench_record(void) {
+    GrainRing ring;
+    ring.begin(bank, RING);
+    double best = 1e9;
+    for (int r = 0; r < RUNS; r++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int b = 0; b < BLOCKS; b++) {
+            ring.record(block(b), AUDIO_BLOCK_SAMPLES);
+        }
+        best = min(best, since(start));
+    }
+    return best;
+}
+
+/**
+ * Plays a block the way GrainHead::play() does. Kept out of line so the
+ * grain isn't folded into constants, which the node can't do either.
+ */
+__attribute__((noinline)) static void play_block(const GrainParams &grain,
+                                                 uint32_t &accumulator,
+                                                 int32_t &position) {
+    int i = 0;
+    while (i < AUDIO_BLOCK_SAMPLES) {
+        if (grain_finished(grain, accumulator, position)) {
+            accumulator = 0;
+            position = 0;
+        }
+        i += grain_play_span<true>(output + i, AUDIO_BLOCK_SAMPLES - i, grain,
+                                   accumulator, position);
+    }
+}
+
+/**
+ * @return ns per block of the kernels playing the grain the node plays
+ */
+static double bench_kernel(void) {
+    GrainParams grain;
+    grain.bank = bank;
+    grain.mask = RING - 1;
+    grain.start = RING / 5;
+    grain.length = RING * 2 / 5;
+    grain.rate = 65536;
+    grain.fade = GRAIN_FADE_SAMPLES;
+    grain.window = grain_window(GRAIN_WINDOW_LINEAR);
+    grain.window_step = grain_window_step(grain.fade);
+    grain.reversed = false;
+    grain.interpolation = GRAIN_INTERP_NONE;
+    uint32_t accumulator = 0;
+    int32_t position = 0;
+    double best = 1e9;
+    for (int r = 0; r < RUNS; r++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int b = 0; b < BLOCKS; b++) {
+            play_block(grain, accumulator, position);
+            sink = output[b & (AUDIO_BLOCK_SAMPLES - 1)];
+        }
+        best = min(best, since(start));
+    }
+    return best;
+}
+
+int main(void) {
+    make_input();
+    bench_baseline(20000);
+    bench_baseline(RING);
+    double idle;
+    double whole = bench_effect(&idle);
+    double record = bench_record();
+    double kernel = bench_kernel();
+    printf("  of which record() %7.1f, kernel %7.1f ns/block\n", record,
+           kernel);
+    printf("  per block, %7.1f idle too and %7.1f only while playing\n",
+           idle - record, whole - idle - kernel);
+    return 0;
+}
@@ -0,0 +1,70 @@
+// file_storage.h
+//
+// Slow storage stand-in for the host tests: a GrainStorage over a temporary
+// file that can only serve so many reads per audio block, like an SD card or
+// SerialFlash chip that's busy. Reads over the budget fail, as a read that
+// timed out would, and the cache tries the page again next time.
+
+#pragma once
+
+#include <stdio.h>
+
+#include <Audio.h>
+
+#include "storage.h"
+
+class FileStorage : public GrainStorage {
+   public:
+    /**
+     * @param len_def Number of samples
+     * @param budget_def Reads served per block, or 0 for no limit
+     */
+    FileStorage(int32_t len_def, int budget_def)
+        : reads(0), len(len_def), budget(budget_def), left(budget_def) {
+        fp = tmpfile();
+        int16_t zero[AUDIO_BLOCK_SAMPLES] = {0};
+        for (int32_t i = 0; i < len; i += AUDIO_BLOCK_SAMPLES) {
+            fwrite(zero, sizeof(zero), 1, fp);
+        }
+    }
+    virtual ~FileStorage(void) { fclose(fp); }
+
+    /**
+     * Starts the next block's budget.
+     */
+    void tick(void) { left = budget; }
+
+    virtual int32_t length(void) { return len; }
+
+    virtual bool read(int32_t index, int16_t *out, int n) {
+        if (index < 0 || index + n > len) {
+            return false;
+        }
+        if (budget > 0) {
+            if (left == 0) {
+                return false;
+            }
+            left--;
+        }
+        reads++;
+        fseek(fp, index * sizeof(int16_t), SEEK_SET);
+        return fread(out, sizeof(int16_t), n, fp) == (size_t)n;
+    }
+
+    virtual bool write(int32_t index, const int16_t *in, int n) {
+        if (index < 0 || index + n > len) {
+            return false;
+        }
+        fseek(fp, index * sizeof(int16_t), SEEK_SET);
+        return fwrite(in, sizeof(int16_t), n, fp) == (size_t)n;
+    }
+
+    // Reads served so far
+    uint32_t reads;
+
+   private:
+    FILE *fp;
+    int32_t len;
+    int budget;
+    int left;
+};
@@ -0,0 +1,53 @@
+// pot_reference.h
+//
+// The pot smoothing before the readings were kept sorted: every tick copies
+// the window and bubble sorts it, then averages the middle band. Kept as the
+// reference for test_pot, and sized by a template parameter so bench_pot can
+// time it at other window sizes.
+
+#pragma once
+
+#include <Arduino.h>
+
+template <int N>
+class BubblePot {
+   public:
+    BubblePot(void) : smooth(0) {
+        for (int i = 0; i < N; i++) {
+            samples[i] = 0;
+        }
+    }
+
+    int loop(int curr) {
+        int sorted[N];
+        smooth = (smooth + 1) % N;
+        samples[smooth] = curr;
+        for (int j = 0; j < N; j++) {
+            sorted[j] = samples[j];
+        }
+        bool done = false;
+        while (!done) {
+            done = true;
+            for (int j = 0; j < N - 1; j++) {
+                if (sorted[j] > sorted[j + 1]) {
+                    int temp = sorted[j + 1];
+                    sorted[j + 1] = sorted[j];
+                    sorted[j] = temp;
+                    done = false;
+                }
+            }
+        }
+        int bottom = max((N * 20) / 100, 1);
+        int top = min(((N * 80) / 100) + 1, N - 1);
+        long total = 0;
+        for (int j = bottom; j < top; j++) {
+            total += sorted[j];
+        }
+        int value = map(total / (top - bottom), 50, 4000, 0, 4095);
+        return value < 0 ? 0 : (value > 4095 ? 4095 : value);
+    }
+
+   private:
+    int samples[N];
+    int smooth;
+};
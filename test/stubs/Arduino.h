@@ -0,0 +1,74 @@
+// Arduino.h
+//
+// Just enough of the Teensy core to build the sketch's sources on a host.
+// Time, pins and analog inputs are simulated and set by the tests.
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <type_traits>
+
+#define PROGMEM
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define LOW 0
+#define HIGH 1
+#define CHANGE 4
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+template <class T, class U>
+static inline auto min(T a, U b) ->
+    typename std::decay<decltype(a < b ? a : b)>::type {
+    return a < b ? a : b;
+}
+template <class T, class U>
+static inline auto max(T a, U b) ->
+    typename std::decay<decltype(a > b ? a : b)>::type {
+    return a > b ? a : b;
+}
+#define constrain(x, lo, hi) ((x) < (lo) ? (lo) : ((x) > (hi) ? (hi) : (x)))
+
+unsigned long millis(void);
+unsigned long micros(void);
+void pinMode(int pin, int mode);
+int digitalRead(int pin);
+void digitalWrite(int pin, int value);
+int digitalPinToInterrupt(int pin);
+void attachInterrupt(int pin, void (*isr)(void), int mode);
+int analogRead(int pin);
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+// Nothing interrupts the host tests
+static inline void __disable_irq(void) {}
+static inline void __enable_irq(void) {}
+
+class HardwareSerial {
+   public:
+    template <class T>
+    void print(T) {}
+    template <class T>
+    void println(T) {}
+    void println(void) {}
+};
+extern HardwareSerial Serial;
+
+// Simulated hardware
+#define STUB_PINS 64
+extern uint32_t stub_us;
+// Makes millis() and micros() follow the host's clock instead of stub_us,
+// for timing real work
+extern bool stub_real_clock;
+extern int stub_analog[STUB_PINS];
+
+/**
+ * Sets a digital input, calling its interrupt if the level changed.
+ */
+void stub_set_pin(int pin, int value);
@@ -0,0 +1,59 @@
+// Audio.h
+//
+// Host stand-in for the Teensy Audio Library's AudioStream. Tests set
+// input before calling update() and read what it transmitted from output.
+
+#pragma once
+
+#include <Arduino.h>
+
+#define AUDIO_BLOCK_SAMPLES 128
+#define AUDIO_SAMPLE_RATE_EXACT 44117.64706f
+
+typedef struct audio_block_struct {
+    int16_t data[AUDIO_BLOCK_SAMPLES];
+} audio_block_t;
+
+#define STUB_INPUTS 4
+
+class AudioStream {
+   public:
+    AudioStream(unsigned char ninput, audio_block_t **iqueue)
+        : input(inputs[0]), has_input(has_inputs[0]), transmitted(false) {
+        (void)ninput;
+        (void)iqueue;
+        for (int i = 0; i < STUB_INPUTS; i++) {
+            has_inputs[i] = false;
+        }
+    }
+    virtual ~AudioStream(void) {}
+    virtual void update(void) = 0;
+
+    // The blocks the next update() receives on each input, and the last one
+    // it sent. input and has_input are the first input.
+    audio_block_t inputs[STUB_INPUTS];
+    bool has_inputs[STUB_INPUTS];
+    audio_block_t &input;
+    bool &has_input;
+    audio_block_t output;
+    bool transmitted;
+
+   protected:
+    audio_block_t *allocate(void) { return new audio_block_t; }
+    audio_block_t *receiveReadOnly(unsigned int index = 0) {
+        return receiveWritable(index);
+    }
+    audio_block_t *receiveWritable(unsigned int index = 0) {
+        if (index >= STUB_INPUTS || !has_inputs[index]) {
+            return NULL;
+        }
+        has_inputs[index] = false;
+        return new audio_block_t(inputs[index]);
+    }
+    void transmit(audio_block_t *block, unsigned char index = 0) {
+        (void)index;
+        output = *block;
+        transmitted = true;
+    }
+    void release(audio_block_t *block) { delete block; }
+};
@@ -0,0 +1,140 @@
+// SD.h
+//
+// Host stand-in for the Teensy SD library, over a directory on the host.
+// Tests point SD.root at it; card paths are taken relative to it.
+
+#pragma once
+
+#include <Arduino.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+
+#define FILE_READ 0
+#define FILE_WRITE 1
+
+typedef struct {
+    uint8_t sec;
+    uint8_t min;
+    uint8_t hour;
+    uint8_t wday;
+    uint8_t mday;
+    uint8_t mon;
+    uint8_t year;
+} DateTimeFields;
+
+class File {
+   public:
+    File(void) : fp(NULL), dir(NULL) {}
+    File(const std::string &path_def, int mode) : fp(NULL), dir(NULL) {
+        path = path_def;
+        struct stat st;
+        if (mode == FILE_READ && stat(path.c_str(), &st) == 0 &&
+            S_ISDIR(st.st_mode)) {
+            dir = opendir(path.c_str());
+        } else {
+            fp = fopen(path.c_str(), mode == FILE_WRITE ? "ab+" : "rb");
+        }
+        size_t slash = path.find_last_of('/');
+        base = slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    operator bool() const { return fp != NULL || dir != NULL; }
+
+    const char *name(void) { return base.c_str(); }
+    bool isDirectory(void) { return dir != NULL; }
+
+    File openNextFile(void) {
+        struct dirent *entry;
+        while (dir != NULL && (entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] != '.') {
+                return File(path + "/" + entry->d_name, FILE_READ);
+            }
+        }
+        return File();
+    }
+
+    uint32_t size(void) {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+    }
+
+    bool getModifyTime(DateTimeFields &tm) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            return false;
+        }
+        // Same resolution as FAT, two seconds
+        time_t t = st.st_mtime;
+        struct tm parts;
+        gmtime_r(&t, &parts);
+        tm.sec = parts.tm_sec & ~1;
+        tm.min = parts.tm_min;
+        tm.hour = parts.tm_hour;
+        tm.wday = parts.tm_wday;
+        tm.mday = parts.tm_mday;
+        tm.mon = parts.tm_mon;
+        tm.year = parts.tm_year;
+        return true;
+    }
+
+    int read(void *buf, size_t n) {
+        return fp == NULL ? -1 : (int)fread(buf, 1, n, fp);
+    }
+    int read(void) {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+    int available(void) {
+        return fp == NULL ? 0 : (int)(size() - position());
+    }
+    uint32_t position(void) { return fp == NULL ? 0 : ftell(fp); }
+    bool seek(uint32_t pos) {
+        return fp != NULL && fseek(fp, pos, SEEK_SET) == 0;
+    }
+    size_t write(const uint8_t *buf, size_t n) {
+        return fp == NULL ? 0 : fwrite(buf, 1, n, fp);
+    }
+
+    void close(void) {
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        if (dir != NULL) {
+            closedir(dir);
+        }
+        fp = NULL;
+        dir = NULL;
+    }
+
+   private:
+    FILE *fp;
+    DIR *dir;
+    std::string path;
+    std::string base;
+};
+
+class SDClass {
+   public:
+    bool begin(int) { return true; }
+    File open(const char *path, int mode = FILE_READ) {
+        return File(root + path, mode);
+    }
+    bool exists(const char *path) {
+        struct stat st;
+        return stat((root + path).c_str(), &st) == 0;
+    }
+    bool remove(const char *path) {
+        return unlink((root + path).c_str()) == 0;
+    }
+    bool rename(const char *from, const char *to) {
+        return ::rename((root + from).c_str(), (root + to).c_str()) == 0;
+    }
+
+    // Host directory the card is read from
+    std::string root;
+};
+extern SDClass SD;
@@ -0,0 +1,3 @@
+// SPI.h
+
+#pragma once
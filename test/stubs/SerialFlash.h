@@ -0,0 +1,24 @@
+// SerialFlash.h
+
+#pragma once
+
+#include <Arduino.h>
+
+class SerialFlashFile {
+   public:
+    operator bool() { return false; }
+    uint32_t read(void *, uint32_t) { return 0; }
+    uint32_t write(const void *, uint32_t) { return 0; }
+    void seek(uint32_t) {}
+    uint32_t size(void) { return 0; }
+    void erase(void) {}
+    void close(void) {}
+};
+
+class SerialFlashChip {
+   public:
+    SerialFlashFile open(const char *) { return SerialFlashFile(); }
+    bool exists(const char *) { return false; }
+    bool createErasable(const char *, uint32_t) { return false; }
+};
+extern SerialFlashChip SerialFlash;
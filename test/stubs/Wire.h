@@ -0,0 +1,3 @@
+// Wire.h
+
+#pragma once
@@ -0,0 +1,26 @@
+// check.h
+//
+// Minimal assertions for the host tests. A failed check prints where it
+// failed and makes the test exit non-zero.
+
+#pragma once
+
+#include <stdio.h>
+
+static int check_failures = 0;
+
+#define CHECK(cond)                                                    \
+    do {                                                               \
+        if (!(cond)) {                                                 \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__,    \
+                   #cond);                                             \
+            check_failures++;                                          \
+        }                                                              \
+    } while (0)
+
+#define CHECK_DONE()                                      \
+    do {                                                  \
+        printf("%s: %s\n", __FILE__,                      \
+               check_failures ? "FAILED" : "ok");         \
+        return check_failures ? 1 : 0;                    \
+    } while (0)
@@ -0,0 +1,56 @@
+#include <Arduino.h>
+#include <SD.h>
+#include <SerialFlash.h>
+#include <time.h>
+
+HardwareSerial Serial;
+SDClass SD;
+SerialFlashChip SerialFlash;
+
+uint32_t stub_us = 0;
+bool stub_real_clock = false;
+int stub_analog[STUB_PINS];
+
+static int pins[STUB_PINS];
+static void (*isrs[STUB_PINS])(void);
+
+unsigned long micros(void) {
+    if (stub_real_clock) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    }
+    return stub_us;
+}
+unsigned long millis(void) { return micros() / 1000; }
+
+void pinMode(int pin, int mode) {
+    if (mode == INPUT_PULLUP) {
+        pins[pin] = HIGH;
+    }
+}
+
+int digitalRead(int pin) { return pins[pin]; }
+void digitalWrite(int pin, int value) { pins[pin] = value; }
+int digitalPinToInterrupt(int pin) { return pin; }
+
+void attachInterrupt(int pin, void (*isr)(void), int mode) {
+    (void)mode;
+    isrs[pin] = isr;
+}
+
+int analogRead(int pin) { return stub_analog[pin]; }
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+void stub_set_pin(int pin, int value) {
+    if (pins[pin] == value) {
+        return;
+    }
+    pins[pin] = value;
+    if (isrs[pin] != NULL) {
+        isrs[pin]();
+    }
+}
@@ -0,0 +1,242 @@
+// Loads a bank from a directory on the host through the SD stand-in, and
+// checks that the cache is used when nothing has changed and rebuilt when
+// a file is edited, even when its size stays the same, or when the cache is
+// cut short. Also reports how long a full bank takes to parse and to load
+// back from the cache.
+
+#include <unistd.h>
+#include <utime.h>
+
+#include <vector>
+
+#include "bank.h"
+#include "check.h"
+
+static void write_file(const std::string &path, const char *text,
+                       time_t mtime) {
+    FILE *fp = fopen(path.c_str(), "wb");
+    fputs(text, fp);
+    fclose(fp);
+    struct utimbuf times = {mtime, mtime};
+    utime(path.c_str(), &times);
+}
+
+/**
+ * Writes a mono PCM WAV file of 8 or 16-bit frames.
+ */
+static void write_wav(const std::string &path, const std::vector<int> &frames,
+                      int bits, time_t mtime) {
+    uint32_t data = frames.size() * bits / 8;
+    uint8_t header[44];
+    memcpy(header, "RIFF", 4);
+    uint32_t riff = 36 + data;
+    memcpy(header + 4, &riff, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    uint32_t fmt_size = 16;
+    uint16_t fmt[] = {1, 1, 0, 0, 0, 0, (uint16_t)(bits / 8),
+                      (uint16_t)bits};
+    uint32_t rate = 44100;
+    uint32_t byte_rate = rate * bits / 8;
+    memcpy(fmt + 2, &rate, 4);
+    memcpy(fmt + 4, &byte_rate, 4);
+    memcpy(header + 16, &fmt_size, 4);
+    memcpy(header + 20, fmt, 16);
+    memcpy(header + 36, "data", 4);
+    memcpy(header + 40, &data, 4);
+
+    FILE *fp = fopen(path.c_str(), "wb");
+    fwrite(header, sizeof(header), 1, fp);
+    for (int frame : frames) {
+        if (bits == 8) {
+            fputc(frame, fp);
+        } else {
+            int16_t sample = frame;
+            fwrite(&sample, sizeof(sample), 1, fp);
+        }
+    }
+    fclose(fp);
+    struct utimbuf times = {mtime, mtime};
+    utime(path.c_str(), &times);
+}
+
+static bool names_are(LFOBank &bank, const char *const *names, int n) {
+    if (bank.table_count() != n) {
+        return false;
+    }
+    for (int i = 0; i < n; i++) {
+        if (strcmp(bank.table_name(i), names[i]) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Loads a bank with a table that can't be parsed and so isn't cached, then
+ * cuts the cache off partway through each section in turn.
+ */
+static void truncated(const std::string &bank_dir, time_t now) {
+    write_file(bank_dir + "/0BAD.CSV", "no numbers here\n", now - 100);
+    write_wav(bank_dir + "/C.WAV", {-32768, 0, 32767}, 16, now - 100);
+    write_wav(bank_dir + "/D.WAV", {0, 64, 128, 255}, 8, now - 100);
+    const char *names[] = {"A.CSV", "B.CSV", "C.WAV", "D.WAV"};
+
+    static LFOBank bank;
+    CHECK(bank.begin("/LFO"));
+    CHECK(!bank.from_cache);
+    CHECK(names_are(bank, names, 4));
+    // 16-bit is signed and 8-bit unsigned, both spread over 0 to 255
+    CHECK(bank.table(2).data[0] == 0);
+    CHECK(bank.table(2).data[LFO_TABLE_SIZE / 2] == 128);
+    CHECK(bank.table(2).data[LFO_TABLE_SIZE] == 255);
+    CHECK(bank.table(3).data[0] == 0);
+    CHECK(bank.table(3).data[LFO_TABLE_SIZE] == 255);
+    CHECK(bank.begin("/LFO"));
+    CHECK(bank.from_cache);
+    CHECK(names_are(bank, names, 4));
+
+    std::string cache = bank_dir + "/LFOBANK.BIN";
+    struct stat st;
+    stat(cache.c_str(), &st);
+    // Size of the cache header
+    const int header = 20;
+    const int cuts[] = {header - 4, header + 24,
+                        header + 4 * LFO_BANK_NAME + 100, (int)st.st_size - 3};
+    for (int cut : cuts) {
+        CHECK(truncate(cache.c_str(), cut) == 0);
+        CHECK(bank.begin("/LFO"));
+        CHECK(!bank.from_cache);
+        CHECK(names_are(bank, names, 4));
+        CHECK(bank.table(2).data[LFO_TABLE_SIZE] == 255);
+        CHECK(bank.preset_count() == 1);
+        CHECK(bank.begin("/LFO"));
+        CHECK(bank.from_cache);
+        CHECK(names_are(bank, names, 4));
+    }
+    CHECK(access((bank_dir + "/LFOBANK.TMP").c_str(), F_OK) != 0);
+
+    remove((bank_dir + "/0BAD.CSV").c_str());
+    remove((bank_dir + "/C.WAV").c_str());
+    remove((bank_dir + "/D.WAV").c_str());
+}
+
+/**
+ * Times a full bank, half CSV and half WAV, parsed and then loaded from the
+ * cache, with the host's clock behind micros().
+ */
+static void timings(const std::string &dir, time_t now) {
+    std::string bank_dir = dir + "/BIG";
+    mkdir(bank_dir.c_str(), 0755);
+    std::vector<std::string> files;
+    for (int t = 0; t < LFO_BANK_TABLES; t++) {
+        char name[16];
+        if (t % 2 == 0) {
+            std::string text;
+            for (int i = 0; i < LFO_BANK_POINTS; i++) {
+                text += std::to_string((i * (t + 3)) % 256) + ", ";
+            }
+            snprintf(name, sizeof(name), "/T%d.CSV", t);
+            write_file(bank_dir + name, text.c_str(), now - 100);
+        } else {
+            std::vector<int> frames;
+            for (int i = 0; i < 4096; i++) {
+                frames.push_back((int)(30000 * sin(i * 0.0015 * t)));
+            }
+            snprintf(name, sizeof(name), "/T%d.WAV", t);
+            write_wav(bank_dir + name, frames, 16, now - 100);
+        }
+        files.push_back(bank_dir + name);
+    }
+    std::string presets;
+    for (int p = 0; p < LFO_BANK_PRESETS; p++) {
+        presets += "preset" + std::to_string(p) + ", 5, free, hann, linear\n";
+    }
+    write_file(bank_dir + "/PRESETS.TXT", presets.c_str(), now - 100);
+    files.push_back(bank_dir + "/PRESETS.TXT");
+    files.push_back(bank_dir + "/LFOBANK.BIN");
+
+    static LFOBank bank;
+    stub_real_clock = true;
+    CHECK(bank.begin("/BIG"));
+    CHECK(!bank.from_cache);
+    uint32_t parse_us = bank.parse_us;
+    CHECK(bank.begin("/BIG"));
+    CHECK(bank.from_cache);
+    uint32_t load_us = bank.load_us;
+    stub_real_clock = false;
+    CHECK(bank.table_count() == LFO_BANK_TABLES);
+    CHECK(bank.preset_count() == LFO_BANK_PRESETS);
+    printf("%d tables and %d presets: parsed in %u us, loaded from the "
+           "cache in %u us\n",
+           LFO_BANK_TABLES, LFO_BANK_PRESETS, parse_us, load_us);
+
+    for (const std::string &file : files) {
+        remove(file.c_str());
+    }
+    rmdir(bank_dir.c_str());
+}
+
+int main(void) {
+    char dir[] = "/tmp/lfobankXXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    SD.root = dir;
+    std::string bank_dir = std::string(dir) + "/LFO";
+    mkdir(bank_dir.c_str(), 0755);
+
+    time_t now = time(NULL);
+    write_file(bank_dir + "/A.CSV", "0, 100, 200\n", now - 100);
+    write_file(bank_dir + "/B.CSV", "255 0\n", now - 100);
+    write_file(bank_dir + "/PRESETS.TXT", "soft, 5, oneshot, hann, linear\n",
+               now - 100);
+
+    static LFOBank bank;
+    CHECK(bank.begin("/LFO"));
+    CHECK(!bank.from_cache);
+    CHECK(bank.table_count() == 2);
+    CHECK(bank.preset_count() == 1);
+    CHECK(bank.table(0).data[LFO_TABLE_SIZE] == 200);
+
+    CHECK(bank.begin("/LFO"));
+    CHECK(bank.from_cache);
+    CHECK(bank.table_count() == 2);
+    CHECK(bank.table(0).data[LFO_TABLE_SIZE] == 200);
+    CHECK(strcmp(bank.preset(0).name, "soft") == 0);
+
+    // Same size, different contents, saved later
+    write_file(bank_dir + "/A.CSV", "0, 100, 150\n", now - 50);
+    CHECK(bank.begin("/LFO"));
+    CHECK(!bank.from_cache);
+    CHECK(bank.table(0).data[LFO_TABLE_SIZE] == 150);
+
+    write_file(bank_dir + "/PRESETS.TXT", "hard, 5, oneshot, hann, linear\n",
+               now - 50);
+    CHECK(bank.begin("/LFO"));
+    CHECK(!bank.from_cache);
+    CHECK(strcmp(bank.preset(0).name, "hard") == 0);
+
+    // A cache written by a build whose tables were a different size
+    std::string cache = bank_dir + "/LFOBANK.BIN";
+    CHECK(bank.begin("/LFO"));
+    CHECK(bank.from_cache);
+    FILE *fp = fopen(cache.c_str(), "r+b");
+    uint16_t table_size = sizeof(LFOTable) + 2;
+    fseek(fp, 16, SEEK_SET);
+    fwrite(&table_size, sizeof(table_size), 1, fp);
+    fclose(fp);
+    CHECK(bank.begin("/LFO"));
+    CHECK(!bank.from_cache);
+    CHECK(bank.table_count() == 2);
+    CHECK(bank.begin("/LFO"));
+    CHECK(bank.from_cache);
+
+    truncated(bank_dir, now);
+    timings(dir, now);
+
+    remove(cache.c_str());
+    remove((bank_dir + "/A.CSV").c_str());
+    remove((bank_dir + "/B.CSV").c_str());
+    remove((bank_dir + "/PRESETS.TXT").c_str());
+    rmdir(bank_dir.c_str());
+    rmdir(dir);
+    CHECK_DONE();
+}
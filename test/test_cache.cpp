@@ -0,0 +1,140 @@
+// Plays the same freezes from RAM and through a GrainCache over slow
+// storage, and checks that the cached heads never miss and play exactly what
+// the RAM heads play.
+
+#include "check.h"
+#include "circular.h"
+#include "file_storage.h"
+
+#define RING 65536
+#define HOLD_BLOCKS 3000
+
+// Pages the storage can read per block, a little over what a head playing
+// at four times speed needs
+#define READS_PER_BLOCK 6
+
+static int16_t bank[RING];
+
+struct Setup {
+    float start;
+    float length;
+    float speed;
+    bool reversed;
+    GrainInterpolation interpolation;
+    // Flips the direction every this many blocks, or 0
+    int flip;
+    // Moves the start every this many blocks, or 0
+    int move;
+};
+
+static void fill(GrainScrubEffectCircular &fx, uint32_t n) {
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        fx.input.data[i] = (int16_t)((n + i) * 37);
+    }
+    fx.has_input = true;
+}
+
+static void apply(GrainScrubEffectCircular &fx, const Setup &setup, int b) {
+    GrainHead *head = fx.head(0);
+    if (b < 0) {
+        head->setStartPos(setup.start);
+        head->setLengthPos(setup.length);
+        head->setSpeed(setup.speed);
+        head->setInterpolation(setup.interpolation);
+        if (setup.reversed) {
+            head->reverse();
+        } else {
+            head->forward();
+        }
+        return;
+    }
+    if (setup.flip > 0 && b % setup.flip == 0) {
+        if ((b / setup.flip) & 1) {
+            head->forward();
+        } else {
+            head->reverse();
+        }
+    }
+    if (setup.move > 0 && b % setup.move == 0) {
+        head->setStartPos(setup.start + 0.01 * ((b / setup.move) % 7));
+    }
+}
+
+/**
+ * @return Samples the cached head played differently from the RAM head
+ */
+static long hold(const Setup &setup, uint32_t *misses) {
+    GrainScrubEffectCircular ram;
+    GrainScrubEffectCircular slow;
+    GrainCache caches[GRAIN_SCRUB_HEADS];
+    FileStorage storage(RING, READS_PER_BLOCK);
+    ram.begin(bank, RING);
+    slow.begin(&storage, caches);
+    apply(ram, setup, -1);
+    apply(slow, setup, -1);
+
+    uint32_t n = 0;
+    for (int b = 0; b < 2 * RING / AUDIO_BLOCK_SAMPLES; b++) {
+        fill(ram, n);
+        fill(slow, n);
+        ram.update();
+        slow.update();
+        storage.tick();
+        slow.service();
+        n += AUDIO_BLOCK_SAMPLES;
+    }
+
+    ram.head(0)->start();
+    slow.head(0)->start();
+    long diff = 0;
+    for (int b = 0; b < HOLD_BLOCKS; b++) {
+        fill(ram, n);
+        fill(slow, n);
+        ram.update();
+        slow.update();
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            diff += ram.output.data[i] != slow.output.data[i];
+        }
+        apply(ram, setup, b);
+        apply(slow, setup, b);
+        storage.tick();
+        slow.service();
+        n += AUDIO_BLOCK_SAMPLES;
+    }
+    *misses = caches[0].misses;
+    return diff;
+}
+
+int main(void) {
+    const Setup setups[] = {
+        // Grains a multiple of the cache long
+        {0.0, 0.5, 1.3, false, GRAIN_INTERP_HERMITE, 0, 0},
+        {0.0, 0.5, 1.3, true, GRAIN_INTERP_HERMITE, 0, 0},
+        {0.25, 0.5, 0.7, false, GRAIN_INTERP_LINEAR, 0, 0},
+        {0.0, 0.5, 1.0, false, GRAIN_INTERP_NONE, 0, 0},
+        {0.0, 1.0, 1.3, false, GRAIN_INTERP_HERMITE, 0, 0},
+        {0.0, 1.0, 4.0, true, GRAIN_INTERP_LINEAR, 0, 0},
+        // Grains shorter than the cache
+        {0.1, 0.11, 1.3, false, GRAIN_INTERP_HERMITE, 0, 0},
+        {0.1, 0.101, 2.0, true, GRAIN_INTERP_HERMITE, 0, 0},
+        // Changing direction and start between grains
+        {0.1, 0.2, 1.3, false, GRAIN_INTERP_HERMITE, 37, 0},
+        {0.1, 0.02, 1.7, false, GRAIN_INTERP_LINEAR, 5, 0},
+        {0.1, 0.5, 1.7, false, GRAIN_INTERP_LINEAR, 5, 0},
+        {0.2, 0.3, 1.3, true, GRAIN_INTERP_HERMITE, 0, 23},
+        {0.2, 0.05, 3.0, false, GRAIN_INTERP_HERMITE, 11, 7},
+    };
+    int count = sizeof(setups) / sizeof(setups[0]);
+    for (int i = 0; i < count; i++) {
+        const Setup &s = setups[i];
+        uint32_t misses;
+        long diff = hold(s, &misses);
+        printf("start %.2f length %.3f speed %.1f %s flip %d move %d: "
+               "%u misses, %ld samples differ\n",
+               s.start, s.length, s.speed, s.reversed ? "rev" : "fwd",
+               s.flip, s.move, misses, diff);
+        CHECK(misses == 0);
+        CHECK(diff == 0);
+    }
+    CHECK_DONE();
+}
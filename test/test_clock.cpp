@@ -0,0 +1,217 @@
+// Plays recorded clock sequences into ClockInput's pin interrupt and checks
+// the tracked tempo through jitter, missed and extra pulses, a tempo change
+// and the clock being unplugged.
+//
+// Each sequence is the time between falling edges in us, recorded from a
+// clock with about 3 ms of jitter, at 120 BPM unless noted. Pulses are 5 ms
+// long.
+
+#include <math.h>
+
+#include "check.h"
+#include "control.h"
+
+#define PIN 20
+#define PULSE_US 5000
+
+static const uint32_t steady[] = {
+    498654, 494419, 504400, 509759, 501539, 504200,
+    504235, 502755, 502730, 503823, 499183, 494953,
+    494391, 502165, 501483, 499887, 492484, 499199,
+    499778, 496756, 497504, 506987, 504364, 502585,
+    500972, 498536, 498811, 502268, 497231, 499250,
+    505356, 495775, 497429, 505824, 501227, 500574,
+    497268, 495372, 503923, 491546, 501502, 498178,
+    499691, 493185, 502915, 501944, 500943, 501375,
+};
+
+// Two pulses are lost where the gap is a full second
+static const uint32_t missed[] = {
+    495567, 500573, 501570, 499739, 489667, 499646,
+    500348, 496319, 500197, 504231, 499703, 504301,
+    995819, 500847, 497070, 494445, 501100, 499994,
+    501922, 497140, 498557, 501597, 498386, 499285,
+    500748, 497525, 500789, 495164, 501614, 1010890,
+    498686, 494681, 496184, 499050, 497460, 501622,
+    500465, 502506, 499261, 502613, 504482, 497043,
+    499647, 499567, 499709, 503744,
+};
+
+// Two stray pulses split a beat
+static const uint32_t extra[] = {
+    498887, 497077, 495623, 495179, 499677, 502926,
+    500169, 497378, 499459, 497031, 503319, 500406,
+    504784, 502182, 184500, 317572, 496953, 501675,
+    498772, 498243, 500624, 505337, 501684, 506630,
+    502257, 495634, 498373, 506228, 502006, 500381,
+    498648, 500677, 501508, 498786, 265577, 234392,
+    501054, 496648, 499346, 497795, 498130, 497283,
+    498161, 497523, 505793, 499627, 501361, 497621,
+    500626, 501614,
+};
+
+// 120 BPM, then 140 BPM from the 25th interval. The beats land within
+// CLOCK_OUTLIER of where they're expected, so the tempo is followed rather
+// than relocked.
+static const uint32_t tempo[] = {
+    502392, 499503, 501499, 498416, 498341, 498448,
+    498251, 504660, 494370, 495438, 500188, 502375,
+    501922, 500800, 503836, 499531, 497293, 500420,
+    500280, 495422, 500516, 500766, 502557, 504903,
+    428340, 426434, 428826, 431129, 426428, 424072,
+    428768, 431244, 429153, 435788, 421833, 426301,
+    428779, 432811, 422255, 425656, 427147, 430197,
+    431630, 421820, 425877, 428422, 431368, 430230,
+    431085, 427292, 424903, 429797, 428681, 430004,
+    420781, 427635,
+};
+
+// 120 BPM, then 80 BPM from the 17th interval, which relocks
+static const uint32_t jump[] = {
+    499495, 503715, 498031, 492690, 497482, 502713,
+    497324, 502686, 505125, 492091, 506379, 496926,
+    502101, 500747, 503640, 498716, 752568, 753299,
+    751999, 749141, 748882, 751473, 752005, 749709,
+    749935, 751216, 750431, 750319, 753672, 750092,
+    749151, 752744, 747708, 748754, 749880, 747762,
+    747119, 750054, 749807, 746720,
+};
+
+#define COUNT(a) (int)(sizeof(a) / sizeof((a)[0]))
+
+static ClockInput clock_in(PIN);
+static uint32_t now = 1000000;
+
+static void at(uint32_t us) {
+    stub_us = us;
+    clock_in.loop(0);
+}
+
+/**
+ * Runs loop() every ms for an interval, then plays the next pulse. The pin
+ * is left low, and is let go PULSE_US into the next interval.
+ */
+static void pulse(uint32_t interval) {
+    uint32_t beat = now + interval;
+    for (uint32_t t = now + 1000; t < beat; t += 1000) {
+        if (t == now + PULSE_US) {
+            stub_us = t;
+            stub_set_pin(PIN, HIGH);
+        }
+        at(t);
+    }
+    now = beat;
+    stub_us = now;
+    stub_set_pin(PIN, LOW);
+    at(now + 300);
+}
+
+static float error(float expected_ms) {
+    return fabsf(clock_in.clock_interval - expected_ms) / expected_ms;
+}
+
+/**
+ * Plays a sequence from a fresh start, and returns the worst period error
+ * from beat `from` on against a tempo of expected_ms.
+ */
+static float play(const uint32_t *intervals, int n, int from,
+                  float expected_ms) {
+    clock_in.reset();
+    now += 5000000;
+    float worst = 0.0;
+    for (int i = 0; i < n; i++) {
+        pulse(intervals[i]);
+        if (i >= from) {
+            CHECK(clock_in.is_clocked);
+            worst = fmaxf(worst, error(expected_ms));
+        }
+    }
+    return worst;
+}
+
+static void jitter(void) {
+    float worst = play(steady, COUNT(steady), 8, 500.0);
+    printf("steady: worst period error %.3f%%\n", worst * 100);
+    CHECK(worst < 0.01);
+
+    // The next beat is predicted to within the jitter
+    uint32_t beat = now;
+    uint32_t next = clock_in.next_beat_us(beat + 20000);
+    CHECK(abs((int32_t)(next - (beat + 500000))) < 10000);
+    CHECK(clock_in.phase(beat + 250000) > 0.45 &&
+          clock_in.phase(beat + 250000) < 0.55);
+
+    // Quantized lengths and speeds follow the tracked tempo
+    CHECK(clock_in.quantize_ms(900.0) == 2 * clock_in.clock_interval);
+    CHECK(clock_in.quantize_ms(260.0) == 0.5 * clock_in.clock_interval);
+    CHECK(clock_in.quantize_speed(0.6) == 0.5);
+}
+
+static void missed_pulses(void) {
+    float worst = play(missed, COUNT(missed), 8, 500.0);
+    printf("missed: worst period error %.3f%%\n", worst * 100);
+    CHECK(worst < 0.01);
+}
+
+static void extra_pulses(void) {
+    float worst = play(extra, COUNT(extra), 8, 500.0);
+    printf("extra: worst period error %.3f%%\n", worst * 100);
+    CHECK(worst < 0.01);
+}
+
+/**
+ * Plays a sequence that changes tempo at interval `change`, and returns how
+ * many beats it took to track the new tempo to within 1%.
+ */
+static int tempo_change(const uint32_t *intervals, int n, int change,
+                        float expected_ms) {
+    float worst = play(intervals, change, 8, 500.0);
+    CHECK(worst < 0.01);
+    int locked = -1;
+    worst = 0.0;
+    for (int i = change; i < n; i++) {
+        pulse(intervals[i]);
+        CHECK(clock_in.is_clocked);
+        float e = error(expected_ms);
+        if (locked < 0 && e < 0.01) {
+            locked = i - change + 1;
+        }
+        if (locked >= 0) {
+            worst = fmaxf(worst, e);
+        }
+    }
+    printf("tempo change to %.0f ms: tracked after %d beats, worst error "
+           "%.3f%%\n",
+           expected_ms, locked, worst * 100);
+    CHECK(worst < 0.01);
+    return locked;
+}
+
+static void relock(void) {
+    // The README promises about four beats for a change this small
+    int beats = tempo_change(tempo, COUNT(tempo), 24, 60000.0 / 140);
+    CHECK(beats > 0 && beats <= 4);
+    beats = tempo_change(jump, COUNT(jump), 16, 750.0);
+    CHECK(beats > 0 && beats <= CLOCK_RELOCK);
+}
+
+static void unplugged(void) {
+    play(steady, COUNT(steady), 8, 500.0);
+    uint32_t last = now;
+    at(last + CLOCK_TIMEOUT * 1000 - 1000);
+    CHECK(clock_in.is_clocked);
+    at(last + CLOCK_TIMEOUT * 1000 + 1000);
+    CHECK(!clock_in.is_clocked);
+    CHECK(clock_in.quantize_ms(900.0) == 900.0);
+}
+
+int main(void) {
+    stub_set_pin(PIN, HIGH);
+    clock_in.setup();
+    jitter();
+    missed_pulses();
+    extra_pulses();
+    relock();
+    unplugged();
+    CHECK_DONE();
+}
@@ -0,0 +1,89 @@
+// Runs GrainCloudEffect through many more grains than it has voices, and
+// checks that spawning and retiring them never touches the heap. The stub's
+// audio blocks come from new, standing in for the audio library's pool, so
+// only allocations of any other size count.
+
+#include <new>
+#include <stdlib.h>
+
+#include "check.h"
+#include "circular.h"
+#include "cloud.h"
+
+#define RING 16384
+
+static int16_t bank[RING];
+static long heap_calls = 0;
+
+void *operator new(size_t size) {
+    if (size != sizeof(audio_block_t)) {
+        heap_calls++;
+    }
+    void *p = malloc(size);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+/**
+ * @return Blocks of the n run that had any sound
+ */
+static int run(GrainCloudEffect &fx, int n) {
+    int sounding = 0;
+    for (int b = 0; b < n; b++) {
+        fx.input.data[AUDIO_BLOCK_SAMPLES - 1] = (b * 331) & 32767;
+        fx.has_input = true;
+        fx.transmitted = false;
+        fx.update();
+        bool any = false;
+        for (int i = 0; fx.transmitted && i < AUDIO_BLOCK_SAMPLES; i++) {
+            any |= fx.output.data[i] != 0;
+        }
+        sounding += any;
+    }
+    return sounding;
+}
+
+int main(void) {
+    static GrainScrubEffectCircular scrub;
+    scrub.begin(bank, RING);
+    uint32_t seed = 1;
+    for (int b = 0; b < 2 * RING / AUDIO_BLOCK_SAMPLES; b++) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            seed = seed * 1664525 + 1013904223;
+            scrub.input.data[i] = seed >> 16;
+        }
+        scrub.has_input = true;
+        scrub.update();
+    }
+
+    static GrainCloudEffect fx;
+    fx.begin(scrub.getRing());
+    fx.setStartPos(0.5);
+    fx.setLengthMs(20.0);
+    fx.modulateJitter(0.25);
+    fx.setDensity(1000.0);
+
+    // 20 ms grains at up to 1000 a second keep all eight voices busy, so
+    // each one retires and spawns again about every 7 blocks
+    long before = heap_calls;
+    int sounding = run(fx, 3000);
+    long calls = heap_calls - before;
+    printf("%d of 3000 blocks sounded, %ld heap allocations\n", sounding,
+           calls);
+    CHECK(sounding == 3000);
+    CHECK(calls == 0);
+
+    // Every voice retires once nothing spawns
+    fx.setDensity(0.0);
+    run(fx, 10);
+    CHECK(run(fx, 100) == 0);
+    fx.setDensity(50.0);
+    CHECK(run(fx, 100) > 0);
+    CHECK(heap_calls == before);
+    CHECK_DONE();
+}
@@ -0,0 +1,97 @@
+// Compares grain_zero_crossing() and grain_zero_crossing_back() with plain
+// per-sample loops on random blocks, from unaligned starts, at every length
+// up to a few words, and on blocks with no crossing at all.
+
+#include <random>
+
+#include "check.h"
+#include "crossing.h"
+
+#define SAMPLES 300
+#define ROUNDS 20000
+
+static int forward(const int16_t *data, int n, int16_t prev) {
+    for (int i = 0; i < n; i++) {
+        bool negative = data[i] < 0;
+        bool was = (i == 0 ? prev : data[i - 1]) < 0;
+        if (negative != was) {
+            return i;
+        }
+    }
+    return n;
+}
+
+static int backward(const int16_t *data, int n, int16_t next) {
+    for (int i = n; i > 0; i--) {
+        bool negative = data[i - 1] < 0;
+        bool was = (i == n ? next : data[i]) < 0;
+        if (negative != was) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+int main(void) {
+    std::mt19937 rng(14);
+    // One spare sample either side for prev and next
+    static int16_t buffer[SAMPLES + 2];
+    long wrong = 0;
+    long none = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        // Mostly long runs of one sign, so crossings land anywhere in a
+        // word and often nowhere at all. Small values and 0 near the sign
+        // boundary.
+        int run = 1 + rng() % 200;
+        bool negative = rng() & 1;
+        for (int i = 0; i < SAMPLES + 2; i++) {
+            if (--run == 0) {
+                negative = !negative;
+                run = 1 + rng() % 200;
+            }
+            int16_t magnitude = rng() % 4 == 0 ? rng() % 3 : rng() % 32768;
+            buffer[i] = negative ? -1 - magnitude : magnitude;
+        }
+
+        int start = 1 + rng() % 7;
+        int n = rng() % (SAMPLES - start);
+        const int16_t *data = buffer + start;
+        int16_t prev = buffer[start - 1];
+        int16_t next = buffer[start + n];
+
+        int expected = forward(data, n, prev);
+        int got = grain_zero_crossing(data, n, prev);
+        wrong += got != expected;
+        none += expected == n;
+
+        expected = backward(data, n, next);
+        got = grain_zero_crossing_back(data, n, next);
+        wrong += got != expected;
+    }
+
+    // Every start and length over a block with no crossing, and one with a
+    // single crossing at each sample in turn
+    static int16_t flat[40];
+    for (int at = 0; at <= 40; at++) {
+        for (int i = 0; i < 40; i++) {
+            flat[i] = i < at ? 5 : -5;
+        }
+        for (int start = 0; start < 8; start++) {
+            for (int n = 0; start + n < 40; n++) {
+                int16_t prev = start > 0 ? flat[start - 1] : flat[0];
+                int16_t next = flat[start + n];
+                const int16_t *data = flat + start;
+                wrong += grain_zero_crossing(data, n, prev) !=
+                         forward(data, n, prev);
+                wrong += grain_zero_crossing_back(data, n, next) !=
+                         backward(data, n, next);
+            }
+        }
+    }
+
+    printf("%ld of %d random blocks had no crossing, %ld results wrong\n",
+           none, ROUNDS, wrong);
+    CHECK(none > ROUNDS / 10);
+    CHECK(wrong == 0);
+    CHECK_DONE();
+}
@@ -0,0 +1,109 @@
+// Schedules start, speed and stop on a head at known sample times, some mid
+// block and some on a block boundary, and checks the output changes at
+// exactly those samples.
+
+#include "check.h"
+#include "circular.h"
+
+#define RING 16384
+#define BLOCKS 40
+
+// Every sample recorded is the low bits of its own time
+static int16_t bank[RING];
+static int16_t out[BLOCKS * AUDIO_BLOCK_SAMPLES];
+
+static int16_t recorded(uint32_t t) { return t & (RING - 1); }
+
+int main(void) {
+    static GrainScrubEffectCircular fx;
+    fx.begin(bank, RING);
+    GrainHead *head = fx.head(0);
+    head->setFadeMs(0.0);
+    head->setStartPos(0.25);
+    head->setLengthPos(0.5);
+
+    uint32_t t = 0;
+    while (t < 2 * RING) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            fx.input.data[i] = recorded(t + i);
+        }
+        fx.has_input = true;
+        fx.update();
+        t += AUDIO_BLOCK_SAMPLES;
+    }
+    uint32_t base = fx.now();
+    CHECK(base == t);
+
+    // Mid block, two blocks on, on a block boundary, and mid block again
+    uint32_t start = base + 72;
+    uint32_t faster = base + 3 * AUDIO_BLOCK_SAMPLES + 5;
+    uint32_t stop = base + 10 * AUDIO_BLOCK_SAMPLES;
+    uint32_t restart = base + 20 * AUDIO_BLOCK_SAMPLES;
+    uint32_t stop_again = base + 25 * AUDIO_BLOCK_SAMPLES + 64;
+    CHECK(head->scheduleStart(start));
+    CHECK(head->scheduleSpeed(faster, 2.0));
+    CHECK(head->scheduleStop(stop));
+    CHECK(head->scheduleStart(restart));
+    CHECK(head->scheduleStop(stop_again));
+
+    for (int b = 0; b < BLOCKS; b++) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            fx.input.data[i] = recorded(t + i);
+        }
+        fx.has_input = true;
+        fx.update();
+        memcpy(out + b * AUDIO_BLOCK_SAMPLES, fx.output.data,
+               sizeof(fx.output.data));
+        t += AUDIO_BLOCK_SAMPLES;
+    }
+
+    // Start: the input passes through until the block the head starts in,
+    // which is silent up to the start and then plays the grain. The freeze
+    // is the ring as it was at that sample, so the grain starts a quarter
+    // of the ring after it.
+    for (uint32_t s = base; s < start; s++) {
+        CHECK(out[s - base] == (s < base + AUDIO_BLOCK_SAMPLES
+                                    ? 0
+                                    : recorded(s)));
+    }
+    int16_t first = recorded(start + RING / 4);
+    CHECK(out[start - base] == first);
+    printf("start at sample %u: output %d, %d\n", start - base,
+           out[start - base - 1], out[start - base]);
+
+    // Speed: the sample at the event is where 1.0 took the read head, and
+    // it moves on at 2.0 from there
+    for (uint32_t s = start + 1; s <= faster; s++) {
+        CHECK(out[s - base] - out[s - base - 1] == 1);
+    }
+    for (uint32_t s = faster + 1; s < stop; s++) {
+        CHECK(out[s - base] - out[s - base - 1] == 2);
+    }
+    printf("speed at sample %u: steps %d, %d\n", faster - base,
+           out[faster - base] - out[faster - base - 1],
+           out[faster - base + 1] - out[faster - base]);
+
+    // Stop on a block boundary: the whole block after it passes the input
+    // through again
+    CHECK(out[stop - base - 1] - out[stop - base - 2] == 2);
+    for (uint32_t s = stop; s < restart; s++) {
+        CHECK(out[s - base] == recorded(s));
+    }
+
+    // Restart on a boundary and stop mid block, leaving the rest of that
+    // block silent
+    CHECK(out[restart - base] == recorded(restart + RING / 4));
+    for (uint32_t s = restart + 1; s < stop_again; s++) {
+        CHECK(out[s - base] - out[s - base - 1] == 2);
+    }
+    uint32_t next_block = base + 26 * AUDIO_BLOCK_SAMPLES;
+    for (uint32_t s = stop_again; s < next_block; s++) {
+        CHECK(out[s - base] == 0);
+    }
+    for (uint32_t s = next_block; s < base + BLOCKS * AUDIO_BLOCK_SAMPLES;
+         s++) {
+        CHECK(out[s - base] == recorded(s));
+    }
+    printf("stops at samples %u and %u\n", stop - base, stop_again - base);
+    CHECK_DONE();
+}
@@ -0,0 +1,226 @@
+// Drives GateTrigger's pin interrupt with simulated edges between calls to
+// loop(), and checks when edges are reported, the 1 ms debounce, short
+// triggers, and what happens when the edge queue fills up.
+
+#include <random>
+#include <vector>
+
+#include "check.h"
+#include "control.h"
+
+// Gates are active low, so pressing pulls the pin low
+#define ON LOW
+#define OFF HIGH
+
+static int next_pin = 10;
+
+/**
+ * A gate with its own pin and interrupt. There are only MAX_GTLS
+ * interrupts, so each test takes one of them for good.
+ */
+static GateTrigger *gate(int *pin) {
+    *pin = next_pin++;
+    GateTrigger *g = new GateTrigger(*pin, 40 + *pin);
+    g->setup();
+    g->loop(0);
+    return g;
+}
+
+static void at(uint32_t us) { stub_us = us; }
+
+static void edge_timing(void) {
+    int pin;
+    GateTrigger *g = gate(&pin);
+    at(10000);
+    stub_set_pin(pin, ON);
+    at(10700);
+    g->loop(0);
+    CHECK(g->high && g->gate);
+    // Stamped by the interrupt, not when loop() got round to it
+    CHECK(g->edge_us == 10000);
+    at(10800);
+    g->loop(0);
+    CHECK(!g->high && !g->low && g->gate);
+
+    at(30000);
+    stub_set_pin(pin, OFF);
+    at(31500);
+    g->loop(0);
+    CHECK(g->low && !g->gate);
+    CHECK(g->edge_us == 30000);
+}
+
+static void short_trigger(void) {
+    int pin;
+    GateTrigger *g = gate(&pin);
+    // Over before loop() runs, and inside the debounce
+    at(50000);
+    stub_set_pin(pin, ON);
+    at(50300);
+    stub_set_pin(pin, OFF);
+    at(52000);
+    g->loop(0);
+    CHECK(g->high);
+    at(52100);
+    g->loop(0);
+    CHECK(g->low);
+    CHECK(g->edge_us >= 51000);
+    at(52200);
+    g->loop(0);
+    CHECK(!g->high && !g->low && !g->gate);
+}
+
+static void debounce(void) {
+    int pin;
+    GateTrigger *g = gate(&pin);
+    int highs = 0;
+    int lows = 0;
+    // Contact bounce for 400 us after the press, settling on
+    at(70000);
+    stub_set_pin(pin, ON);
+    for (uint32_t t = 70050; t < 70400; t += 50) {
+        at(t);
+        stub_set_pin(pin, (t / 50) % 2 ? OFF : ON);
+        g->loop(0);
+        highs += g->high;
+        lows += g->low;
+    }
+    at(70450);
+    stub_set_pin(pin, ON);
+    for (uint32_t t = 70500; t < 73000; t += 100) {
+        at(t);
+        g->loop(0);
+        highs += g->high;
+        lows += g->low;
+    }
+    CHECK(highs == 1 && lows == 0 && g->gate);
+
+    // Bouncing on release, settling off: one low, once it's settled
+    at(80000);
+    stub_set_pin(pin, OFF);
+    at(80100);
+    stub_set_pin(pin, ON);
+    at(80200);
+    stub_set_pin(pin, OFF);
+    for (uint32_t t = 80300; t < 83000; t += 100) {
+        at(t);
+        g->loop(0);
+        highs += g->high;
+        lows += g->low;
+    }
+    CHECK(highs == 1 && lows == 1 && !g->gate);
+
+    // A second press 500 us after a release is held back until the debounce
+    // is over, then taken at the level it settled at
+    at(90000);
+    stub_set_pin(pin, ON);
+    at(90100);
+    g->loop(0);
+    CHECK(g->high);
+    at(91200);
+    stub_set_pin(pin, OFF);
+    at(91300);
+    g->loop(0);
+    CHECK(g->low);
+    at(91700);
+    stub_set_pin(pin, ON);
+    at(91800);
+    g->loop(0);
+    CHECK(!g->high);
+    at(92400);
+    g->loop(0);
+    CHECK(g->high && g->gate);
+}
+
+static void overflow(void) {
+    int pin;
+    GateTrigger *g = gate(&pin);
+    // Far more edges than the queue holds before loop() runs. The last one
+    // that fits leaves the gate off, but the pin ends up on.
+    uint32_t t = 100000;
+    for (int i = 0; i < 4 * GATE_EDGE_QUEUE + 1; i++) {
+        at(t += 2000);
+        stub_set_pin(pin, i % 2 ? OFF : ON);
+    }
+    int highs = 0;
+    for (int i = 0; i < 4 * GATE_EDGE_QUEUE; i++) {
+        at(t += 100);
+        g->loop(0);
+        highs += g->high;
+    }
+    // The queued edges still come out as triggers, and then the gate is
+    // read back from the pin
+    CHECK(highs > 1);
+    CHECK(g->gate);
+    CHECK(digitalRead(pin) == ON);
+}
+
+/**
+ * Random triggers, some shorter than the debounce and all with contact
+ * bounce, while loop() runs every 20 to 200 us.
+ */
+static void random_triggers(void) {
+    int pin;
+    GateTrigger *g = gate(&pin);
+    struct Edge {
+        uint32_t us;
+        int level;
+    };
+    std::vector<Edge> edges;
+    std::vector<uint32_t> presses;
+    std::mt19937 rng(1);
+    uint32_t t = 200000;
+    for (int i = 0; i < 2000; i++) {
+        t += 5000 + rng() % 40000;
+        presses.push_back(t);
+        edges.push_back({t, ON});
+        for (int b = 0; b < 3; b++) {
+            edges.push_back({t + 50 + b * 80, OFF});
+            edges.push_back({t + 90 + b * 80, ON});
+        }
+        t += i % 3 == 0 ? 300 + rng() % 400 : 2000 + rng() % 20000;
+        edges.push_back({t, OFF});
+    }
+
+    size_t next = 0;
+    size_t press = 0;
+    int highs = 0;
+    int lows = 0;
+    uint32_t worst = 0;
+    uint32_t now = 200000;
+    while (now < t + 100000) {
+        now += 20 + rng() % 180;
+        while (next < edges.size() && edges[next].us <= now) {
+            at(edges[next].us);
+            stub_set_pin(pin, edges[next].level);
+            next++;
+        }
+        at(now);
+        g->loop(0);
+        if (g->high) {
+            highs++;
+            // Reported by the first loop() after the press, stamped with
+            // the press itself
+            if (press < presses.size()) {
+                CHECK(g->edge_us == presses[press]);
+                worst = max(worst, now - presses[press]);
+            }
+            press++;
+        }
+        lows += g->low;
+    }
+    printf("random triggers: %zu presses, %d highs, %d lows, worst %u us\n",
+           presses.size(), highs, lows, worst);
+    CHECK(highs == (int)presses.size());
+    CHECK(lows == (int)presses.size());
+    CHECK(worst <= 200);
+}
+
+int main(void) {
+    edge_timing();
+    short_trigger();
+    debounce();
+    overflow();
+    random_triggers();
+    CHECK_DONE();
+}
@@ -0,0 +1,264 @@
+// Feeds held values into the modulation inputs of GrainScrubEffectCircular
+// and GrainCloudEffect, and checks that heads take them up at grain
+// boundaries and the cloud's jitter follows them.
+
+#include <vector>
+
+#include "check.h"
+#include "circular.h"
+#include "cloud.h"
+
+#define RING 16384
+
+// Every sample recorded is its own index in the ring
+static int16_t bank[RING];
+static int32_t counter;
+
+static void begin(GrainScrubEffectCircular &fx) {
+    fx.begin(bank, RING);
+    counter = 0;
+    for (int h = 0; h < GRAIN_SCRUB_HEADS; h++) {
+        fx.head(h)->setFadeMs(0.0);
+    }
+}
+
+/**
+ * Runs a block with value on the modulation input, or nothing connected
+ * when it's negative.
+ */
+static void block(GrainScrubEffectCircular &fx, int value) {
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        fx.input.data[i] = counter++ & (RING - 1);
+    }
+    fx.has_input = true;
+    if (value >= 0) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            // Only the last sample counts
+            fx.inputs[1].data[i] = i == AUDIO_BLOCK_SAMPLES - 1 ? value : 0;
+        }
+        fx.has_inputs[1] = true;
+    }
+    fx.update();
+}
+
+/**
+ * Fills the ring, then freezes head 0 with value on the modulation input.
+ */
+static void freeze(GrainScrubEffectCircular &fx, int value) {
+    for (int b = 0; b < 2 * RING / AUDIO_BLOCK_SAMPLES; b++) {
+        block(fx, value);
+    }
+    fx.head(0)->start();
+}
+
+/**
+ * Plays blocks, noting where each grain starts and how long it is.
+ */
+static void grains(GrainScrubEffectCircular &fx, int value, int blocks,
+                   std::vector<int> &starts, std::vector<int> &lengths,
+                   int16_t &last, int &run) {
+    for (int b = 0; b < blocks; b++) {
+        block(fx, value);
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            int16_t sample = fx.output.data[i];
+            if (run > 0 && sample == last + 1) {
+                run++;
+            } else {
+                if (run > 0) {
+                    lengths.push_back(run);
+                }
+                starts.push_back(sample);
+                run = 1;
+            }
+            last = sample;
+        }
+    }
+}
+
+static void start(void) {
+    static GrainScrubEffectCircular fx;
+    begin(fx);
+    GrainHead *head = fx.head(0);
+    head->setLengthPos(0.1);
+    head->modulateStart();
+    // A quarter of the ring, latched by the freeze itself
+    freeze(fx, 8192);
+    std::vector<int> starts, lengths;
+    int16_t last = 0;
+    int run = 0;
+    grains(fx, 8192, 20, starts, lengths, last, run);
+    CHECK(starts.size() >= 2);
+    for (size_t i = 0; i < starts.size(); i++) {
+        CHECK(starts[i] == RING / 4);
+    }
+
+    // Mid-grain, so the grain playing finishes where it was going
+    size_t before = starts.size();
+    grains(fx, 16384, 20, starts, lengths, last, run);
+    CHECK(lengths.size() >= before);
+    for (size_t i = 0; i + 1 < lengths.size(); i++) {
+        CHECK(lengths[i] == lengths[0]);
+    }
+    CHECK(starts.size() > before);
+    for (size_t i = before; i < starts.size(); i++) {
+        CHECK(starts[i] == RING / 2);
+    }
+
+    // Nothing connected holds the last value
+    before = starts.size();
+    grains(fx, -1, 20, starts, lengths, last, run);
+    CHECK(starts.size() > before);
+    for (size_t i = before; i < starts.size(); i++) {
+        CHECK(starts[i] == RING / 2);
+    }
+
+    // Snapped to a grid, and handed back to the setter
+    head->modulateStart(1000);
+    before = starts.size();
+    grains(fx, 16384, 20, starts, lengths, last, run);
+    for (size_t i = before + 1; i < starts.size(); i++) {
+        CHECK(starts[i] == 8000);
+    }
+    head->unmodulate();
+    head->setStartPos(0.75);
+    before = starts.size();
+    grains(fx, 16384, 20, starts, lengths, last, run);
+    for (size_t i = before + 1; i < starts.size(); i++) {
+        CHECK(starts[i] == 3 * RING / 4);
+    }
+    printf("start: %zu grains\n", starts.size());
+}
+
+static void length(void) {
+    static GrainScrubEffectCircular fx;
+    begin(fx);
+    GrainHead *head = fx.head(0);
+    head->setStartPos(0.25);
+    head->modulateLength();
+    // The end is at half the ring
+    freeze(fx, 16384);
+    std::vector<int> starts, lengths;
+    int16_t last = 0;
+    int run = 0;
+    grains(fx, 16384, 200, starts, lengths, last, run);
+    CHECK(lengths.size() >= 2);
+    for (size_t i = 0; i < lengths.size(); i++) {
+        CHECK(lengths[i] == RING / 4);
+    }
+
+    // Quantized to a beat of 1500 samples, so the end at 8192 snaps to
+    // 6000 and the length is 6000 - 4096
+    head->modulateLength(1500);
+    size_t before = lengths.size();
+    grains(fx, 16384, 200, starts, lengths, last, run);
+    CHECK(lengths.size() > before + 1);
+    for (size_t i = before + 1; i < lengths.size(); i++) {
+        CHECK(lengths[i] == 6000 - RING / 4);
+    }
+    printf("length: %zu grains\n", lengths.size());
+}
+
+static void speed(void) {
+    static GrainScrubEffectCircular fx;
+    begin(fx);
+    GrainHead *head = fx.head(0);
+    head->setStartPos(0.25);
+    head->setLengthPos(0.75);
+    head->modulateSpeed(true);
+    // Rounds to two octaves up
+    freeze(fx, 24576);
+    block(fx, 24576);
+    for (int i = 1; i < AUDIO_BLOCK_SAMPLES; i++) {
+        CHECK(fx.output.data[i] - fx.output.data[i - 1] == 4);
+    }
+    // Rounds to 1.0, once the grain playing has finished
+    int fast = 0, slow = 0, fast_after = 0;
+    for (int b = 0; b < 300; b++) {
+        block(fx, 16384);
+        for (int i = 1; i < AUDIO_BLOCK_SAMPLES; i++) {
+            int step = fx.output.data[i] - fx.output.data[i - 1];
+            fast += step == 4;
+            slow += step == 1;
+            fast_after += step == 4 && slow > 0;
+        }
+    }
+    CHECK(fast > 20 * AUDIO_BLOCK_SAMPLES);
+    CHECK(slow > 250 * AUDIO_BLOCK_SAMPLES);
+    CHECK(fast_after == 0);
+
+    head->unmodulate();
+    head->setSpeed(2.0);
+    int steps = 0;
+    for (int b = 0; b < 300; b++) {
+        block(fx, 16384);
+        for (int i = 1; i < AUDIO_BLOCK_SAMPLES; i++) {
+            steps += fx.output.data[i] - fx.output.data[i - 1] == 2;
+        }
+    }
+    CHECK(steps > 150 * AUDIO_BLOCK_SAMPLES);
+    printf("speed: %d steps of 4, %d of 1, %d of 2 after unmodulate()\n",
+           fast, slow, steps);
+}
+
+/**
+ * Plays a cloud for a while from a ring of noise.
+ *
+ * @param value Held on the modulation input, or negative for none
+ * @return Every sample of output
+ */
+static std::vector<int16_t> cloud(bool modulated, float jitter, int value) {
+    static GrainScrubEffectCircular scrub;
+    begin(scrub);
+    uint32_t seed = 1;
+    for (int b = 0; b < 2 * RING / AUDIO_BLOCK_SAMPLES; b++) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            seed = seed * 1664525 + 1013904223;
+            scrub.input.data[i] = seed >> 16;
+        }
+        scrub.has_input = true;
+        scrub.update();
+    }
+
+    static GrainCloudEffect fx;
+    fx.begin(scrub.getRing());
+    fx.setStartPos(0.5);
+    fx.setLengthMs(20.0);
+    fx.setDensity(200.0);
+    if (modulated) {
+        fx.modulateJitter(jitter);
+    } else {
+        fx.setJitter(jitter);
+    }
+    std::vector<int16_t> out;
+    for (int b = 0; b < 200; b++) {
+        if (value >= 0) {
+            for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+                fx.input.data[i] = value;
+            }
+            fx.has_input = true;
+        }
+        fx.transmitted = false;
+        fx.update();
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            out.push_back(fx.transmitted ? fx.output.data[i] : 0);
+        }
+    }
+    return out;
+}
+
+static void jitter(void) {
+    // Lowest and highest, against the same jitter set directly
+    CHECK(cloud(true, 0.5, 0) == cloud(false, 0.0, -1));
+    CHECK(cloud(true, 0.5, 32767) == cloud(false, 8191.0 / RING, -1));
+    CHECK(cloud(true, 0.5, 32767) != cloud(false, 0.0, -1));
+    // setJitter() takes it back
+    CHECK(cloud(false, 0.25, 32767) == cloud(false, 0.25, -1));
+}
+
+int main(void) {
+    start();
+    length();
+    speed();
+    jitter();
+    CHECK_DONE();
+}
@@ -0,0 +1,152 @@
+// Checks ModulationLFO's fixed-point rendering against the float formula it
+// replaced, across shapes, offsets and depths, LFOPhase's divide-free
+// increment against a divide, and mode changes.
+
+#include <random>
+
+#include "check.h"
+#include "modulation.h"
+
+static WavetableLFO square(1000, TBL_SQUARE);
+static WavetableLFO ramp(1000, TBL_RAMP);
+static WavetableLFO wobble(1000, TBL_WOBBLE);
+static WavetableLFO tri(1000, TBL_TRI);
+static WavetableLFO saw(1000, TBL_SAW);
+static WavetableLFO *tables[] = {&square, &ramp, &wobble, &tri, &saw};
+static WavetableMatrixLFO matrix(1000, 5, tables);
+
+/**
+ * The matrix mix and output scaling as they were, in float.
+ */
+static int32_t reference(uint32_t phase, float shape, int32_t centre,
+                         int32_t depth) {
+    float pos = shape * (5 - 0.8);
+    unsigned int index = pos;
+    float ratio = pos - index;
+    float a = tables[index]->at_fine(phase) / 65280.0;
+    float mixed = a;
+    if (index + 1 < 5) {
+        float b = tables[index + 1]->at_fine(phase) / 65280.0;
+        mixed = (1.0 - ratio) * a + ratio * b;
+    }
+    int32_t lfo = mixed * 32768.0 - 16384;
+    int32_t out = centre + ((lfo * depth) >> 15);
+    return out < 0 ? 0 : (out > 32767 ? 32767 : out);
+}
+
+/**
+ * Works out increments the way set_period() does, from the last one, for
+ * slow pot turns, jumps between the ends of the range, and the extremes.
+ */
+static void reciprocal(void) {
+    std::mt19937 rng(17);
+    long wrong = 0;
+    uint32_t increment = 0;
+    uint32_t period = 2206;
+    for (int i = 0; i < 200000; i++) {
+        switch (i % 4) {
+            case 0:
+                period = rng() % 2 ? period + 1 : max(period - 1, 1u);
+                break;
+            case 1:
+                period = 2206 + rng() % 44118;
+                break;
+            case 2:
+                period = 1 + rng() % 64;
+                break;
+            default:
+                period = rng() | 1;
+                break;
+        }
+        increment = LFOPhase::reciprocal(period, increment);
+        wrong += increment != 0xFFFFFFFF / period;
+    }
+    const uint32_t edges[] = {1, 2, 3, 0x7FFFFFFF, 0x80000000, 0x80000001,
+                              0xFFFFFFFE, 0xFFFFFFFF};
+    for (uint32_t edge : edges) {
+        wrong += LFOPhase::reciprocal(edge, 0) != 0xFFFFFFFF / edge;
+        wrong += LFOPhase::reciprocal(edge, 12345) != 0xFFFFFFFF / edge;
+    }
+    printf("divide-free increments: %ld wrong\n", wrong);
+    CHECK(wrong == 0);
+}
+
+static bool still(ModulationLFO &lfo) {
+    for (int i = 1; i < AUDIO_BLOCK_SAMPLES; i++) {
+        if (lfo.output.data[i] != lfo.output.data[0]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Mode changes from the control loop land at the next block.
+ */
+static void modes(void) {
+    ModulationLFO lfo(&matrix);
+    matrix.set_shape(0.5);
+    lfo.set_time(50);
+    for (int b = 0; b < 5; b++) {
+        lfo.update();
+    }
+    CHECK(!still(lfo));
+
+    // 50 ms is 18 blocks, after which a one-shot holds its last value
+    lfo.set_mode(LFO_ONE_SHOT);
+    lfo.trigger();
+    for (int b = 0; b < 18; b++) {
+        lfo.update();
+        CHECK(!still(lfo));
+    }
+    lfo.update();
+    CHECK(still(lfo));
+    lfo.update();
+    CHECK(still(lfo));
+
+    lfo.set_mode(LFO_FREE);
+    lfo.update();
+    CHECK(!still(lfo));
+}
+
+int main(void) {
+    reciprocal();
+    modes();
+
+    const float shapes[] = {0.0, 0.1, 0.25, 0.5, 0.61, 0.9, 1.0};
+    const float offsets[] = {0.0, 0.5, 0.8};
+    const float depths[] = {0.0, 0.3, 1.0};
+    int worst = 0;
+    for (float shape : shapes) {
+        for (float offset : offsets) {
+            for (float depth : depths) {
+                ModulationLFO lfo(&matrix);
+                matrix.set_shape(shape);
+                lfo.set_time(50);
+                lfo.offset(offset);
+                lfo.depth(depth);
+                int32_t centre = offset * 32767.0;
+                int32_t scale = depth * 32767.0;
+
+                // The same phase the LFO keeps, stepped alongside it
+                LFOPhase phase;
+                phase.set_period(50 * AUDIO_SAMPLE_RATE_EXACT * 0.001);
+                uint32_t clock = 0;
+                for (int b = 0; b < 40; b++) {
+                    lfo.update();
+                    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+                        int32_t want = reference(phase.advance(clock++),
+                                                 shape, centre, scale);
+                        int diff = abs(lfo.output.data[i] - want);
+                        if (diff > worst) {
+                            worst = diff;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    printf("worst difference from the float version: %d of 32767\n", worst);
+    CHECK(worst <= 2);
+    CHECK_DONE();
+}
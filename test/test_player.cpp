@@ -0,0 +1,240 @@
+// Runs every GrainPlayer configuration through each recorder: the one-shot
+// and pre-roll GrainScrubEffect, and a GrainHead over the circular ring.
+// Each must play something, stay within the input's level, give the same
+// output every time, and sound different when any one setting changes.
+//
+// A head over a 2^18 sample ring then plays one grain each way, reading far
+// past the old 16-bit limit and across the ring's wrap, and every sample is
+// checked against the one recorded at that time.
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "circular.h"
+#include "effect.h"
+
+#define BANK 16384
+#define BLOCKS 400
+#define PEAK 12000
+#define LONG_RING (1 << 18)
+
+enum Recorder { ONE_SHOT, PRE_ROLL, RING_HEAD, RECORDERS };
+static const char *recorder_names[] = {"one-shot", "pre-roll", "ring head"};
+
+struct Config {
+    Recorder recorder;
+    GrainWindowShape window;
+    GrainInterpolation interpolation;
+    bool reversed;
+    float speed;
+};
+
+static int16_t bank[BANK];
+static int16_t long_bank[LONG_RING];
+
+// A slow sine, which crosses zero often enough for the one-shot recorder
+static int16_t input(uint32_t n) {
+    return PEAK * sin(n * 2.0 * M_PI / 441.0);
+}
+
+template <class Player>
+static void setup(Player *player, const Config &c) {
+    player->setStartPos(0.1);
+    player->setLengthPos(0.4);
+    player->setFadeShape(c.window);
+    player->setFadeMs(20.0);
+    player->setInterpolation(c.interpolation);
+    player->setSpeed(c.speed);
+    if (c.reversed) {
+        player->reverse();
+    } else {
+        player->forward();
+    }
+}
+
+template <class Effect>
+static void feed(Effect &fx, uint32_t n) {
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        fx.input.data[i] = input(n + i);
+    }
+    fx.has_input = true;
+    fx.update();
+}
+
+static std::vector<int16_t> run(const Config &c) {
+    std::vector<int16_t> out;
+    uint32_t n = 0;
+    if (c.recorder == RING_HEAD) {
+        static GrainScrubEffectCircular fx;
+        fx.begin(bank, BANK);
+        GrainHead *head = fx.head(0);
+        setup(head, c);
+        for (int b = 0; b < 2 * BANK / AUDIO_BLOCK_SAMPLES; b++) {
+            feed(fx, n);
+            n += AUDIO_BLOCK_SAMPLES;
+        }
+        head->start();
+        for (int b = 0; b < BLOCKS; b++) {
+            feed(fx, n);
+            n += AUDIO_BLOCK_SAMPLES;
+            out.insert(out.end(), fx.output.data,
+                       fx.output.data + AUDIO_BLOCK_SAMPLES);
+        }
+    } else {
+        static GrainScrubEffect fx;
+        fx.begin(bank, BANK);
+        fx.setPreRoll(c.recorder == PRE_ROLL);
+        setup(&fx, c);
+        for (int b = 0; b < 2 * BANK / AUDIO_BLOCK_SAMPLES; b++) {
+            feed(fx, n);
+            n += AUDIO_BLOCK_SAMPLES;
+        }
+        fx.start();
+        for (int b = 0; b < BLOCKS; b++) {
+            feed(fx, n);
+            n += AUDIO_BLOCK_SAMPLES;
+            out.insert(out.end(), fx.output.data,
+                       fx.output.data + AUDIO_BLOCK_SAMPLES);
+        }
+    }
+    return out;
+}
+
+/**
+ * Every sample of the long ring is a hash of the time it was recorded.
+ */
+static int16_t stamp(uint32_t n) { return (n * 2654435761u) >> 16; }
+
+/**
+ * Plays the first grain of a head over the long ring.
+ *
+ * @return Samples that weren't the one recorded where the grain was
+ */
+static long long_grain(bool reversed) {
+    static GrainScrubEffectCircular fx;
+    fx.begin(long_bank, LONG_RING);
+    GrainHead *head = fx.head(0);
+    head->setFadeMs(0.0);
+    head->setStartPos(0.05);
+    head->setLengthPos(0.8);
+    if (reversed) {
+        head->reverse();
+    }
+    int32_t offset = LONG_RING * 0.05f;
+    int32_t length = LONG_RING * 0.8f;
+
+    // Freeze with the oldest sample far enough into the ring that the
+    // grain wraps
+    uint32_t n = 0;
+    while (n < LONG_RING + 640 * AUDIO_BLOCK_SAMPLES) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            fx.input.data[i] = stamp(n + i);
+        }
+        fx.has_input = true;
+        fx.update();
+        n += AUDIO_BLOCK_SAMPLES;
+    }
+    uint32_t first = n - LONG_RING + offset;
+    CHECK(((n & (LONG_RING - 1)) + offset + length) > LONG_RING);
+    head->start();
+
+    long wrong = 0;
+    int32_t k = 0;
+    int blocks = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (k + AUDIO_BLOCK_SAMPLES <= length) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            fx.input.data[i] = stamp(n + i);
+        }
+        fx.has_input = true;
+        fx.update();
+        n += AUDIO_BLOCK_SAMPLES;
+        blocks++;
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++, k++) {
+            uint32_t at = reversed ? first + length - 1 - k : first + k;
+            wrong += fx.output.data[i] != stamp(at);
+        }
+    }
+    std::chrono::duration<double, std::nano> took =
+        std::chrono::steady_clock::now() - start;
+    printf("%d sample grain %s over a %d sample ring: %ld samples wrong, "
+           "%.1f ns/block\n",
+           k, reversed ? "backwards" : "forwards", LONG_RING, wrong,
+           took.count() / blocks);
+    return wrong;
+}
+
+static std::string describe(const Config &c) {
+    static const char *windows[] = {"linear", "power", "hann"};
+    static const char *interps[] = {"none", "linear", "hermite"};
+    char text[96];
+    snprintf(text, sizeof(text), "%s %s fade %s interp %s speed %.1f",
+             recorder_names[c.recorder], c.reversed ? "rev" : "fwd",
+             windows[c.window], interps[c.interpolation], c.speed);
+    return text;
+}
+
+int main(void) {
+    const float speeds[] = {0.6, 1.0, 1.7};
+    std::map<std::string, std::vector<int16_t>> outputs;
+    std::vector<Config> configs;
+    for (int r = 0; r < RECORDERS; r++) {
+        for (int w = 0; w < GRAIN_WINDOW_SHAPES; w++) {
+            for (int i = GRAIN_INTERP_NONE; i <= GRAIN_INTERP_HERMITE; i++) {
+                for (int rev = 0; rev < 2; rev++) {
+                    for (float speed : speeds) {
+                        Config c = {(Recorder)r, (GrainWindowShape)w,
+                                    (GrainInterpolation)i, rev != 0, speed};
+                        configs.push_back(c);
+                    }
+                }
+            }
+        }
+    }
+
+    int failed = 0;
+    for (const Config &c : configs) {
+        std::vector<int16_t> out = run(c);
+        int peak = 0;
+        long loud = 0;
+        for (int16_t s : out) {
+            peak = max(peak, abs(s));
+            loud += abs(s) > PEAK / 2;
+        }
+        // Interpolating a sine can only overshoot it a little
+        bool ok = peak <= PEAK + PEAK / 100 && loud > (long)out.size() / 8 &&
+                  run(c) == out;
+        if (!ok) {
+            printf("%s: peak %d, %ld loud samples\n", describe(c).c_str(),
+                   peak, loud);
+            failed++;
+        }
+        CHECK(ok);
+        outputs[describe(c)] = out;
+    }
+
+    // Changing any one setting changes what's heard. Interpolation only
+    // matters away from speed 1.0.
+    for (const Config &c : configs) {
+        Config other = c;
+        other.reversed = !c.reversed;
+        CHECK(outputs[describe(c)] != outputs[describe(other)]);
+        other = c;
+        other.window = (GrainWindowShape)((c.window + 1) % GRAIN_WINDOW_SHAPES);
+        CHECK(outputs[describe(c)] != outputs[describe(other)]);
+        if (c.speed != 1.0) {
+            other = c;
+            other.interpolation =
+                (GrainInterpolation)((c.interpolation + 1) % 3);
+            CHECK(outputs[describe(c)] != outputs[describe(other)]);
+        }
+    }
+    printf("%d of %d configurations failed\n", failed, (int)configs.size());
+
+    CHECK(long_grain(false) == 0);
+    CHECK(long_grain(true) == 0);
+    CHECK_DONE();
+}
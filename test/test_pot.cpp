@@ -0,0 +1,66 @@
+// Feeds the same readings to Potentiometer and to the bubble sort it
+// replaced, and checks that they always agree.
+
+#include <random>
+
+#include "check.h"
+#include "control.h"
+#include "pot_reference.h"
+
+static int reading = 0;
+
+static int source(int) { return reading; }
+
+/**
+ * @return Ticks on which the two disagreed
+ */
+static long compare(int (*signal)(long t, std::mt19937 &rng), long ticks) {
+    AnalogScanner scanner;
+    scanner.set_source(source);
+    Potentiometer pot(0);
+    pot.attach(&scanner, scanner.add(0));
+    BubblePot<POT_SMOOTH_SAMPLES> old;
+    std::mt19937 rng(1);
+    long wrong = 0;
+    for (long t = 0; t < ticks; t++) {
+        reading = constrain(signal(t, rng), 0, 4095);
+        scanner.tick();
+        pot.loop(0);
+        wrong += pot.value != old.loop(reading);
+    }
+    return wrong;
+}
+
+static int at_rest(long, std::mt19937 &rng) { return 2048 + rng() % 5; }
+
+static int turning(long t, std::mt19937 &rng) {
+    return 2000 + 1500 * sin(t * 0.001) + rng() % 40;
+}
+
+static int spiky(long t, std::mt19937 &rng) {
+    return turning(t, rng) + (rng() % 100 == 0 ? 2000 : 0);
+}
+
+static int stepping(long t, std::mt19937 &) { return (t / 50) % 2 ? 4095 : 0; }
+
+static int random_reading(long, std::mt19937 &rng) { return rng() % 4096; }
+
+// Long runs of equal readings, which the binary search has to handle
+static int repeats(long t, std::mt19937 &rng) {
+    return (t / 7) % 3 * 1000 + (rng() % 10 == 0);
+}
+
+int main(void) {
+    struct {
+        const char *name;
+        int (*signal)(long t, std::mt19937 &rng);
+    } signals[] = {{"at rest", at_rest},   {"turning", turning},
+                   {"spiky", spiky},       {"stepping", stepping},
+                   {"random", random_reading}, {"repeats", repeats}};
+    for (auto &s : signals) {
+        long wrong = compare(s.signal, 100000);
+        printf("%s: %ld of 100000 ticks differ\n", s.name, wrong);
+        CHECK(wrong == 0);
+    }
+    CHECK_DONE();
+}
@@ -0,0 +1,113 @@
+// Triggers GrainScrubEffect on a known sawtooth in one-shot and pre-roll
+// modes, and checks the sample the grain first sounds at and which part of
+// the input it plays.
+
+#include "check.h"
+#include "effect.h"
+
+#define BANK 8192
+#define TRIGGER_BLOCK 100
+#define TRIGGER (TRIGGER_BLOCK * AUDIO_BLOCK_SAMPLES)
+
+static int16_t bank[BANK];
+
+/**
+ * Input at sample n, a sawtooth 256 samples long that crosses zero off the
+ * block boundaries.
+ */
+static int16_t input(int32_t n) { return (((n + 37) & 255) - 128) * 100; }
+
+static bool crossing(int32_t n) { return (input(n) ^ input(n - 1)) < 0; }
+
+struct Result {
+    // Samples after the trigger the grain's first sample is output at, or
+    // -1 if it never is
+    int32_t first;
+    // Input sample that the first output of the grain is
+    int16_t sound;
+    // The output up to the first sound was the input passed through
+    bool passed;
+};
+
+static Result trigger(bool preroll, float start, float length_ms) {
+    static GrainScrubEffect fx;
+    fx.begin(bank, BANK);
+    fx.setPreRoll(preroll);
+    fx.setFadeMs(0.0);
+    fx.setStartPos(start);
+    fx.setLengthMs(length_ms);
+
+    Result result = {-1, 0, true};
+    for (int b = 0; b < TRIGGER_BLOCK + 200 && result.first < 0; b++) {
+        if (b == TRIGGER_BLOCK) {
+            fx.start();
+        }
+        int32_t t = b * AUDIO_BLOCK_SAMPLES;
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            fx.input.data[i] = input(t + i);
+        }
+        fx.has_input = true;
+        fx.update();
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            if (fx.output.data[i] == input(t + i)) {
+                continue;
+            }
+            if (t + i < TRIGGER) {
+                result.passed = false;
+                continue;
+            }
+            result.first = t + i - TRIGGER;
+            result.sound = fx.output.data[i];
+            break;
+        }
+    }
+    return result;
+}
+
+static void one_shot(float start, float length_ms) {
+    Result r = trigger(false, start, length_ms);
+    int32_t offset = start * BANK;
+    int32_t length = length_ms * AUDIO_SAMPLE_RATE_EXACT * 0.001;
+    // Recording starts at the first crossing from the trigger, and the
+    // grain plays once its last sample is in
+    int32_t z = TRIGGER;
+    while (!crossing(z)) {
+        z++;
+    }
+    int32_t expected = z + offset + length - 1 - TRIGGER;
+    printf("one-shot, start %.2f, %.0f ms: first sound %d samples after "
+           "the trigger, expected %d\n",
+           start, length_ms, r.first, expected);
+    CHECK(r.passed);
+    CHECK(r.first == expected);
+    CHECK(r.sound == input(z + offset));
+}
+
+static void preroll(float start, float length_ms) {
+    Result r = trigger(true, start, length_ms);
+    int32_t offset = start * BANK;
+    int32_t length = length_ms * AUDIO_SAMPLE_RATE_EXACT * 0.001;
+    // The grain starts from the last crossing that lets all of it play from
+    // before the trigger
+    int32_t c = TRIGGER - (offset + length);
+    while (!crossing(c)) {
+        c--;
+    }
+    printf("pre-roll, start %.2f, %.0f ms: first sound %d samples after "
+           "the trigger, from input sample %d\n",
+           start, length_ms, r.first, c + offset - TRIGGER);
+    CHECK(r.passed);
+    CHECK(r.first == 0);
+    CHECK(r.sound == input(c + offset));
+    CHECK(c + offset + length <= TRIGGER);
+}
+
+int main(void) {
+    one_shot(0.1, 50.0);
+    one_shot(0.0, 20.0);
+    one_shot(0.5, 10.0);
+    preroll(0.1, 50.0);
+    preroll(0.0, 20.0);
+    preroll(0.5, 10.0);
+    CHECK_DONE();
+}
@@ -0,0 +1,93 @@
+// Runs AnalogScanner for one simulated second at ANALOG_SCAN_RATE, laid out
+// like the sketch with four pots and a CV input, and checks how many
+// readings each channel gets and that each comes from its own pin.
+
+#include "check.h"
+#include "scanner.h"
+
+// Pins in the order they were read
+static int order[ANALOG_SCAN_RATE];
+static int reads = 0;
+
+static int source(int pin) {
+    if (reads < ANALOG_SCAN_RATE) {
+        order[reads++] = pin;
+    }
+    return pin * 100;
+}
+
+/**
+ * Ticks the scanner through one second.
+ */
+static void second(AnalogScanner &scanner) {
+    for (int t = 0; t < ANALOG_SCAN_RATE; t++) {
+        scanner.tick();
+    }
+}
+
+static void sketch(void) {
+    AnalogScanner scanner;
+    scanner.set_source(source);
+    int pots[4];
+    for (int i = 0; i < 4; i++) {
+        pots[i] = scanner.add(10 + i);
+    }
+    int cv = scanner.add(20, true);
+    reads = 0;
+    second(scanner);
+
+    // The CV input takes every other conversion, and the pots share the
+    // rest
+    printf("sketch: CV %u reads/s, pots %u %u %u %u reads/s\n",
+           scanner.count(cv), scanner.count(pots[0]), scanner.count(pots[1]),
+           scanner.count(pots[2]), scanner.count(pots[3]));
+    CHECK(scanner.count(cv) == ANALOG_SCAN_RATE / 2);
+    CHECK(scanner.count(cv) == 4000);
+    for (int i = 0; i < 4; i++) {
+        CHECK(scanner.count(pots[i]) == ANALOG_SCAN_RATE / 8);
+        CHECK(scanner.count(pots[i]) == 1000);
+        CHECK(scanner.latest(pots[i]) == (10 + i) * 100);
+    }
+    CHECK(scanner.latest(cv) == 2000);
+
+    // Evenly spaced: the CV every other conversion, and each pot every
+    // eighth
+    for (int i = 0; i < ANALOG_SCAN_RATE; i++) {
+        CHECK(order[i] == (i % 2 ? 20 : 10 + (i / 2) % 4));
+    }
+}
+
+static void shares(void) {
+    // Two fast channels split their half
+    AnalogScanner two;
+    two.set_source(source);
+    int slow = two.add(1);
+    int a = two.add(2, true);
+    int b = two.add(3, true);
+    second(two);
+    CHECK(two.count(a) == ANALOG_SCAN_RATE / 4);
+    CHECK(two.count(b) == ANALOG_SCAN_RATE / 4);
+    CHECK(two.count(slow) == ANALOG_SCAN_RATE / 2);
+
+    // With no fast channels the slow ones take every conversion, and the
+    // other way round
+    AnalogScanner pots;
+    pots.set_source(source);
+    int p = pots.add(1);
+    int q = pots.add(2);
+    second(pots);
+    CHECK(pots.count(p) == ANALOG_SCAN_RATE / 2);
+    CHECK(pots.count(q) == ANALOG_SCAN_RATE / 2);
+
+    AnalogScanner cvs;
+    cvs.set_source(source);
+    int c = cvs.add(1, true);
+    second(cvs);
+    CHECK(cvs.count(c) == ANALOG_SCAN_RATE);
+}
+
+int main(void) {
+    sketch();
+    shares();
+    CHECK_DONE();
+}
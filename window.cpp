@@ -0,0 +1,22 @@
+#include "window.h"
+
+static int16_t window_tables[GRAIN_WINDOW_SHAPES][GRAIN_WINDOW_SIZE + 1];
+static bool window_tables_ready = false;
+
+const int16_t *grain_window(GrainWindowShape shape) {
+    if (!window_tables_ready) {
+        for (int i = 0; i <= GRAIN_WINDOW_SIZE; i++) {
+            float x = (float)i / GRAIN_WINDOW_SIZE;
+            window_tables[GRAIN_WINDOW_LINEAR][i] = x * 32767.0 + 0.5;
+            window_tables[GRAIN_WINDOW_EQUAL_POWER][i] =
+                sinf(x * (float)M_PI * 0.5f) * 32767.0 + 0.5;
+            window_tables[GRAIN_WINDOW_HANN][i] =
+                (0.5f - 0.5f * cosf(x * (float)M_PI)) * 32767.0 + 0.5;
+        }
+        window_tables_ready = true;
+    }
+    if (shape < 0 || shape >= GRAIN_WINDOW_SHAPES) {
+        shape = GRAIN_WINDOW_LINEAR;
+    }
+    return window_tables[shape];
+}
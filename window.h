@@ -0,0 +1,47 @@
+// window.h
+
+#include <Arduino.h>
+
+#pragma once
+
+#ifndef M_WINDOW_H_
+#define M_WINDOW_H_
+
+/**
+ * Resolution of the grain window tables. Every table holds the rising half of
+ * a window as GRAIN_WINDOW_SIZE + 1 Q15 gains, so the cost of a fade is a
+ * lookup and a multiply no matter how long the fade is.
+ */
+#define GRAIN_WINDOW_BITS 8
+#define GRAIN_WINDOW_SIZE (1 << GRAIN_WINDOW_BITS)
+
+enum GrainWindowShape {
+    GRAIN_WINDOW_LINEAR,
+    GRAIN_WINDOW_EQUAL_POWER,
+    GRAIN_WINDOW_HANN,
+    GRAIN_WINDOW_SHAPES
+};
+
+/**
+ * Returns the Q15 table for a window shape, building the tables the first
+ * time it's called. Call it from begin() so the tables are never built in
+ * the audio interrupt.
+ *
+ * @param shape Shape of the fade
+ */
+const int16_t *grain_window(GrainWindowShape shape);
+
+/**
+ * Calculates the 16.16 fixed-point table step for a fade of the given
+ * length, so the kernels can index the table with a multiply and a shift.
+ *
+ * @param fade Length of the fade in samples
+ */
+static inline uint32_t grain_window_step(int32_t fade) {
+    if (fade <= 0) {
+        return 0;
+    }
+    return ((uint32_t)GRAIN_WINDOW_SIZE << 16) / fade;
+}
+
+#endif